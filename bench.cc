@@ -0,0 +1,504 @@
+#include <deque>
+#include <iostream>
+#include <vector>
+#include <string_view>
+#include <cmath>
+#include <cstdlib>
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <wayland-server.h>
+#include "xdg-shell-v6-server.h"
+#include "zwp-tablet-v2-server.h"
+#include "safe.hh"
+
+extern char** environ;
+
+// Stand-in compositor for benchmarking the client without a GPU or a
+// display: it offers just the globals the client binds, completes every
+// frame right after its commit, and floods the seat and a tablet tool with
+// synthetic input at fixed rates.  The client runs as a child process with
+// --present shm and reports its own frame, latency and allocation figures
+// on exit; this side reports throughput and the child's CPU time.
+
+namespace
+{
+    struct options {
+        char const* client = "./wayland-sycl-client";
+        double duration = 5;
+        double pointer_hz = 1000;
+        double touch_hz = 120;
+        int fingers = 10;
+        double tablet_hz = 300;
+        int width = 640;
+        int height = 480;
+    };
+    inline auto parse_options(int argc, char** argv, location loc = location::current()) {
+        options opts;
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            auto value = [&]() {
+                if (++i == argc) {
+                    throw fatal_error("missing option value", loc);
+                }
+                return argv[i];
+            };
+            if (arg == "--client") {
+                opts.client = value();
+            }
+            else if (arg == "--duration") {
+                opts.duration = std::atof(value());
+            }
+            else if (arg == "--pointer-hz") {
+                opts.pointer_hz = std::atof(value());
+            }
+            else if (arg == "--touch-hz") {
+                opts.touch_hz = std::atof(value());
+            }
+            else if (arg == "--fingers") {
+                opts.fingers = std::atoi(value());
+            }
+            else if (arg == "--tablet-hz") {
+                opts.tablet_hz = std::atof(value());
+            }
+            else {
+                std::cerr << "usage: " << argv[0]
+                          << " [--client PATH] [--duration S]"
+                          << " [--pointer-hz N] [--touch-hz N] [--fingers N] [--tablet-hz N]"
+                          << std::endl;
+                throw fatal_error("unknown option", loc);
+            }
+        }
+        return opts;
+    }
+
+    inline uint32_t now_ms() noexcept {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000 + ts.tv_nsec / 1'000'000;
+    }
+    inline double now_s() noexcept {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec + ts.tv_nsec * 1e-9;
+    }
+
+    // Request handlers for requests the stand-in has no use for.
+    template <class... Args>
+    void ignore(wl_client*, wl_resource*, Args...) noexcept { }
+    inline void destroy_resource(wl_client*, wl_resource* resource) noexcept {
+        wl_resource_destroy(resource);
+    }
+
+    // What a global's bind hands to the resources it creates.
+    struct binding {
+        wl_interface const* interface;
+        void const* impl;
+        struct server* s;
+    };
+
+    // Everything the server knows about its single client.
+    struct server {
+        wl_display* display;
+        wl_resource* surface = nullptr;
+        wl_resource* xsurface = nullptr;
+        wl_resource* toplevel = nullptr;
+        wl_resource* pointer = nullptr;
+        wl_resource* keyboard = nullptr;
+        wl_resource* touch = nullptr;
+        wl_resource* tablet_seat = nullptr;
+        wl_resource* tablet = nullptr;
+        wl_resource* tool = nullptr;
+        wl_resource* attached = nullptr;
+        std::vector<wl_resource*> callbacks = { };
+        // One per global, at a fixed address for as long as the display.
+        std::deque<binding> bindings = { };
+        bool configured = false;
+        uint64_t commits = 0;
+        uint64_t events = 0; // sent to the client
+        int width = 640;
+        int height = 480;
+    };
+    inline server& self(wl_resource* resource) noexcept {
+        return *static_cast<server*>(wl_resource_get_user_data(resource));
+    }
+    // Forgets `slot' when the client destroys the resource it holds.
+    template <wl_resource* server::* slot>
+    void forget(wl_resource* resource) noexcept {
+        auto& s = self(resource);
+        if (s.*slot == resource) {
+            s.*slot = nullptr;
+        }
+    }
+    inline void forget_callback(wl_resource* resource) noexcept {
+        auto& callbacks = self(resource).callbacks;
+        std::erase(callbacks, resource);
+    }
+
+    // wl_surface: a commit is the end of a frame.  The buffer is released
+    // right away, as if copied, and every frame callback is completed.
+    struct wl_surface_interface const surface_impl = {
+        .destroy = destroy_resource,
+        .attach = [](wl_client*, wl_resource* resource, wl_resource* buffer, int32_t, int32_t) noexcept {
+            self(resource).attached = buffer;
+        },
+        .damage = ignore<int32_t, int32_t, int32_t, int32_t>,
+        .frame = [](wl_client* client, wl_resource* resource, uint32_t id) noexcept {
+            auto& s = self(resource);
+            auto callback = wl_resource_create(client, &wl_callback_interface, 1, id);
+            wl_resource_set_implementation(callback, nullptr, &s, forget_callback);
+            s.callbacks.push_back(callback);
+        },
+        .set_opaque_region = ignore<wl_resource*>,
+        .set_input_region = ignore<wl_resource*>,
+        .commit = [](wl_client*, wl_resource* resource) noexcept {
+            auto& s = self(resource);
+            if (!s.configured && s.toplevel) {
+                wl_array states;
+                wl_array_init(&states);
+                zxdg_toplevel_v6_send_configure(s.toplevel, s.width, s.height, &states);
+                wl_array_release(&states);
+                zxdg_surface_v6_send_configure(s.xsurface, wl_display_next_serial(s.display));
+                s.configured = true;
+                return;
+            }
+            if (s.attached) {
+                wl_buffer_send_release(s.attached);
+                s.attached = nullptr;
+                ++s.commits;
+            }
+            auto time = now_ms();
+            for (auto callback : std::exchange(s.callbacks, { })) {
+                wl_callback_send_done(callback, time);
+                wl_resource_destroy(callback);
+            }
+        },
+        .set_buffer_transform = ignore<int32_t>,
+        .set_buffer_scale = ignore<int32_t>,
+        .damage_buffer = ignore<int32_t, int32_t, int32_t, int32_t>,
+    };
+    struct wl_region_interface const region_impl = {
+        .destroy = destroy_resource,
+        .add = ignore<int32_t, int32_t, int32_t, int32_t>,
+        .subtract = ignore<int32_t, int32_t, int32_t, int32_t>,
+    };
+    struct wl_compositor_interface const compositor_impl = {
+        .create_surface = [](wl_client* client, wl_resource* resource, uint32_t id) noexcept {
+            auto& s = self(resource);
+            auto surface = wl_resource_create(client, &wl_surface_interface,
+                                              wl_resource_get_version(resource), id);
+            wl_resource_set_implementation(surface, &surface_impl, &s, forget<&server::surface>);
+            s.surface = surface;
+        },
+        .create_region = [](wl_client* client, wl_resource* resource, uint32_t id) noexcept {
+            auto region = wl_resource_create(client, &wl_region_interface, 1, id);
+            wl_resource_set_implementation(region, &region_impl, nullptr, nullptr);
+        },
+    };
+
+    struct zxdg_toplevel_v6_interface const toplevel_impl = {
+        .destroy = destroy_resource,
+        .set_parent = ignore<wl_resource*>,
+        .set_title = ignore<char const*>,
+        .set_app_id = ignore<char const*>,
+        .show_window_menu = ignore<wl_resource*, uint32_t, int32_t, int32_t>,
+        .move = ignore<wl_resource*, uint32_t>,
+        .resize = ignore<wl_resource*, uint32_t, uint32_t>,
+        .set_max_size = ignore<int32_t, int32_t>,
+        .set_min_size = ignore<int32_t, int32_t>,
+        .set_maximized = ignore<>,
+        .unset_maximized = ignore<>,
+        .set_fullscreen = ignore<wl_resource*>,
+        .unset_fullscreen = ignore<>,
+        .set_minimized = ignore<>,
+    };
+    struct zxdg_surface_v6_interface const xsurface_impl = {
+        .destroy = destroy_resource,
+        .get_toplevel = [](wl_client* client, wl_resource* resource, uint32_t id) noexcept {
+            auto& s = self(resource);
+            auto toplevel = wl_resource_create(client, &zxdg_toplevel_v6_interface, 1, id);
+            wl_resource_set_implementation(toplevel, &toplevel_impl, &s, forget<&server::toplevel>);
+            s.toplevel = toplevel;
+        },
+        .get_popup = ignore<uint32_t, wl_resource*, wl_resource*>,
+        .set_window_geometry = ignore<int32_t, int32_t, int32_t, int32_t>,
+        .ack_configure = ignore<uint32_t>,
+    };
+    struct zxdg_shell_v6_interface const shell_impl = {
+        .destroy = destroy_resource,
+        .create_positioner = ignore<uint32_t>,
+        .get_xdg_surface = [](wl_client* client, wl_resource* resource, uint32_t id,
+                              wl_resource*) noexcept {
+            auto& s = self(resource);
+            auto xsurface = wl_resource_create(client, &zxdg_surface_v6_interface, 1, id);
+            wl_resource_set_implementation(xsurface, &xsurface_impl, &s, forget<&server::xsurface>);
+            s.xsurface = xsurface;
+        },
+        .pong = ignore<uint32_t>,
+    };
+
+    struct wl_pointer_interface const pointer_impl = {
+        .set_cursor = ignore<uint32_t, wl_resource*, int32_t, int32_t>,
+        .release = destroy_resource,
+    };
+    struct wl_keyboard_interface const keyboard_impl = {
+        .release = destroy_resource,
+    };
+    struct wl_touch_interface const touch_impl = {
+        .release = destroy_resource,
+    };
+    struct wl_seat_interface const seat_impl = {
+        .get_pointer = [](wl_client* client, wl_resource* resource, uint32_t id) noexcept {
+            auto& s = self(resource);
+            s.pointer = wl_resource_create(client, &wl_pointer_interface,
+                                           wl_resource_get_version(resource), id);
+            wl_resource_set_implementation(s.pointer, &pointer_impl, &s, forget<&server::pointer>);
+        },
+        .get_keyboard = [](wl_client* client, wl_resource* resource, uint32_t id) noexcept {
+            auto& s = self(resource);
+            s.keyboard = wl_resource_create(client, &wl_keyboard_interface,
+                                            wl_resource_get_version(resource), id);
+            wl_resource_set_implementation(s.keyboard, &keyboard_impl, &s, forget<&server::keyboard>);
+        },
+        .get_touch = [](wl_client* client, wl_resource* resource, uint32_t id) noexcept {
+            auto& s = self(resource);
+            s.touch = wl_resource_create(client, &wl_touch_interface,
+                                         wl_resource_get_version(resource), id);
+            wl_resource_set_implementation(s.touch, &touch_impl, &s, forget<&server::touch>);
+        },
+        .release = destroy_resource,
+    };
+
+    struct zwp_tablet_tool_v2_interface const tool_impl = {
+        .set_cursor = ignore<uint32_t, wl_resource*, int32_t, int32_t>,
+        .destroy = destroy_resource,
+    };
+    struct zwp_tablet_v2_interface const tablet_impl = {
+        .destroy = destroy_resource,
+    };
+    struct zwp_tablet_seat_v2_interface const tablet_seat_impl = {
+        .destroy = destroy_resource,
+    };
+    // One tablet with one pen, announced as soon as the tablet seat exists.
+    struct zwp_tablet_manager_v2_interface const tablet_manager_impl = {
+        .get_tablet_seat = [](wl_client* client, wl_resource* resource, uint32_t id,
+                              wl_resource*) noexcept {
+            auto& s = self(resource);
+            s.tablet_seat = wl_resource_create(client, &zwp_tablet_seat_v2_interface, 1, id);
+            wl_resource_set_implementation(s.tablet_seat, &tablet_seat_impl, &s,
+                                           forget<&server::tablet_seat>);
+            s.tablet = wl_resource_create(client, &zwp_tablet_v2_interface, 1, 0);
+            wl_resource_set_implementation(s.tablet, &tablet_impl, &s, forget<&server::tablet>);
+            zwp_tablet_seat_v2_send_tablet_added(s.tablet_seat, s.tablet);
+            zwp_tablet_v2_send_name(s.tablet, "stand-in tablet");
+            zwp_tablet_v2_send_done(s.tablet);
+            s.tool = wl_resource_create(client, &zwp_tablet_tool_v2_interface, 1, 0);
+            wl_resource_set_implementation(s.tool, &tool_impl, &s, forget<&server::tool>);
+            zwp_tablet_seat_v2_send_tool_added(s.tablet_seat, s.tool);
+            zwp_tablet_tool_v2_send_type(s.tool, ZWP_TABLET_TOOL_V2_TYPE_PEN);
+            zwp_tablet_tool_v2_send_capability(s.tool, ZWP_TABLET_TOOL_V2_CAPABILITY_PRESSURE);
+            zwp_tablet_tool_v2_send_capability(s.tool, ZWP_TABLET_TOOL_V2_CAPABILITY_TILT);
+            zwp_tablet_tool_v2_send_done(s.tool);
+        },
+        .destroy = destroy_resource,
+    };
+
+    template <class Impl>
+    void add_global(wl_display* display, wl_interface const* interface, int version,
+                    Impl const* impl, server* s, location loc = location::current())
+    {
+        auto& b = s->bindings.emplace_back(binding{ interface, impl, s });
+        auto bind = [](wl_client* client, void* data, uint32_t version, uint32_t id) noexcept {
+            auto b = static_cast<binding*>(data);
+            auto resource = wl_resource_create(client, b->interface, version, id);
+            wl_resource_set_implementation(resource, b->impl, b->s, nullptr);
+            if (b->interface == &wl_seat_interface) {
+                wl_seat_send_capabilities(resource, WL_SEAT_CAPABILITY_POINTER |
+                                                    WL_SEAT_CAPABILITY_KEYBOARD |
+                                                    WL_SEAT_CAPABILITY_TOUCH);
+            }
+        };
+        if (!wl_global_create(display, interface, version, &b, bind)) {
+            throw fatal_error("cannot create global", loc);
+        }
+    }
+
+    // A synthetic source emitting `hz' samples per second, catching up on
+    // whatever a late tick missed.
+    struct stream {
+        double hz;
+        double start;
+        uint64_t sent = 0;
+        uint64_t due(double now) noexcept {
+            auto target = static_cast<uint64_t>((now - this->start) * this->hz);
+            auto n = target - std::min(target, this->sent);
+            this->sent += n;
+            return n;
+        }
+    };
+} // ::(anonymous)
+
+int main(int argc, char** argv) {
+    try {
+        auto const opts = parse_options(argc, argv);
+        auto display = safe_ptr(wl_display_create(), wl_display_destroy);
+        auto socket = wl_display_add_socket_auto(display.get());
+        if (!socket || wl_display_init_shm(display.get()) != 0) {
+            throw fatal_error("cannot set up the stand-in compositor", location::current());
+        }
+        server s{.display = display.get(), .width = opts.width, .height = opts.height};
+        add_global(display.get(), &wl_compositor_interface, 4, &compositor_impl, &s);
+        add_global(display.get(), &zxdg_shell_v6_interface, 1, &shell_impl, &s);
+        add_global(display.get(), &wl_seat_interface, 5, &seat_impl, &s);
+        add_global(display.get(), &zwp_tablet_manager_v2_interface, 1, &tablet_manager_impl, &s);
+
+        setenv("WAYLAND_DISPLAY", socket, 1);
+        char present[] = "--present";
+        char shm[] = "shm";
+        char* child_argv[] = { const_cast<char*>(opts.client), present, shm, nullptr };
+        pid_t child;
+        if (posix_spawn(&child, opts.client, nullptr, nullptr, child_argv, environ) != 0) {
+            throw fatal_error("cannot start the client", location::current());
+        }
+
+        auto loop = wl_display_get_event_loop(display.get());
+        auto ticker = safe_fd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK));
+        itimerspec period{ { 0, 1'000'000 }, { 0, 1'000'000 } };
+        timerfd_settime(ticker.get(), 0, &period, nullptr);
+
+        double begin = 0;
+        stream pointer{opts.pointer_hz, 0};
+        stream touch{opts.touch_hz, 0};
+        stream tablet{opts.tablet_hz, 0};
+        bool touching = false;
+        bool entered = false;
+        auto inject = [&](double now) {
+            auto t = now - begin;
+            auto time = now_ms();
+            auto cx = s.width / 2.0;
+            auto cy = s.height / 2.0;
+            auto r = std::min(cx, cy) * 0.8;
+            if (s.pointer && s.surface && !entered) {
+                wl_pointer_send_enter(s.pointer, wl_display_next_serial(display.get()), s.surface,
+                                      wl_fixed_from_double(cx), wl_fixed_from_double(cy));
+                entered = true;
+            }
+            for (auto n = pointer.due(now); n && s.pointer; --n) {
+                wl_pointer_send_motion(s.pointer, time,
+                                       wl_fixed_from_double(cx + r * std::cos(t * 3)),
+                                       wl_fixed_from_double(cy + r * std::sin(t * 3)));
+                ++s.events;
+                if (wl_resource_get_version(s.pointer) >= WL_POINTER_FRAME_SINCE_VERSION) {
+                    wl_pointer_send_frame(s.pointer);
+                    ++s.events;
+                }
+            }
+            for (auto n = touch.due(now); n && s.touch && s.surface; --n) {
+                for (int id = 0; id < opts.fingers; ++id) {
+                    auto a = t + id * 2 * M_PI / opts.fingers;
+                    auto x = wl_fixed_from_double(cx + r * 0.5 * std::cos(a));
+                    auto y = wl_fixed_from_double(cy + r * 0.5 * std::sin(a));
+                    if (touching) {
+                        wl_touch_send_motion(s.touch, time, id, x, y);
+                    }
+                    else {
+                        wl_touch_send_down(s.touch, wl_display_next_serial(display.get()), time,
+                                           s.surface, id, x, y);
+                    }
+                    ++s.events;
+                }
+                touching = true;
+                wl_touch_send_frame(s.touch);
+                ++s.events;
+            }
+            for (auto n = tablet.due(now); n && s.tool && s.tablet && s.surface; --n) {
+                if (tablet.sent == n) {
+                    zwp_tablet_tool_v2_send_proximity_in(s.tool, wl_display_next_serial(display.get()),
+                                                         s.tablet, s.surface);
+                    zwp_tablet_tool_v2_send_down(s.tool, wl_display_next_serial(display.get()));
+                    s.events += 2;
+                }
+                zwp_tablet_tool_v2_send_motion(s.tool,
+                                               wl_fixed_from_double(cx + r * std::cos(-t * 2)),
+                                               wl_fixed_from_double(cy + r * std::sin(-t * 2)));
+                zwp_tablet_tool_v2_send_pressure(s.tool, 32768 + 32767 * std::sin(t * 7));
+                zwp_tablet_tool_v2_send_tilt(s.tool, wl_fixed_from_int(10), wl_fixed_from_int(20));
+                zwp_tablet_tool_v2_send_frame(s.tool, time);
+                s.events += 4;
+            }
+        };
+        auto on_tick = [](int fd, uint32_t, void* data) noexcept {
+            uint64_t expirations;
+            if (::read(fd, &expirations, sizeof (expirations)) > 0) {
+                (*static_cast<decltype (inject)*>(data))(now_s());
+            }
+            return 0;
+        };
+        wl_event_source* tick = nullptr;
+
+        // Input starts once the client has a configured surface; it ends
+        // with an Escape press and release, on which the client exits.
+        bool finished = false;
+        rusage usage{};
+        int status = 0;
+        double end = 0;
+        while (!finished) {
+            wl_event_loop_dispatch(loop, 10);
+            wl_display_flush_clients(display.get());
+            if (!tick && s.configured && s.keyboard) {
+                begin = now_s();
+                pointer.start = touch.start = tablet.start = begin;
+                tick = wl_event_loop_add_fd(loop, ticker.get(), WL_EVENT_READABLE, on_tick, &inject);
+            }
+            if (tick && !end && now_s() - begin >= opts.duration) {
+                end = now_s();
+                wl_event_source_remove(tick);
+                if (s.keyboard && s.surface) {
+                    // Keys go to the surface with keyboard focus.
+                    wl_array keys;
+                    wl_array_init(&keys);
+                    wl_keyboard_send_enter(s.keyboard, wl_display_next_serial(display.get()),
+                                           s.surface, &keys);
+                    wl_array_release(&keys);
+                    auto time = now_ms();
+                    wl_keyboard_send_key(s.keyboard, wl_display_next_serial(display.get()), time, 1,
+                                         WL_KEYBOARD_KEY_STATE_PRESSED);
+                    wl_keyboard_send_key(s.keyboard, wl_display_next_serial(display.get()), time, 1,
+                                         WL_KEYBOARD_KEY_STATE_RELEASED);
+                }
+            }
+            if (wait4(child, &status, WNOHANG, &usage) == child) {
+                finished = true;
+            }
+            else if (end && now_s() - end > 10) {
+                kill(child, SIGKILL);
+                wait4(child, &status, 0, &usage);
+                throw fatal_error("the client did not exit", location::current());
+            }
+        }
+        if (!end) {
+            throw fatal_error("the client exited before the benchmark ran", location::current());
+        }
+
+        auto seconds = end - begin;
+        auto cpu = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+            usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+        std::cout << "duration: " << seconds << " s\n"
+                  << "events sent: " << s.events << ", " << s.events / seconds << " /s\n"
+                  << "frames: " << s.commits << ", " << s.commits / seconds << " /s\n"
+                  << "client cpu: " << cpu << " s, "
+                  << (s.events ? cpu * 1e6 / s.events : 0) << " us/event sent\n"
+                  << "client max rss: " << usage.ru_maxrss << " KiB" << std::endl;
+        return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+    catch (fatal_error& ex) {
+        std::cerr << ex << std::endl;
+    }
+    return -1;
+}
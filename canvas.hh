@@ -0,0 +1,241 @@
+#ifndef INCLUDE_CANVAS_HH_
+#define INCLUDE_CANVAS_HH_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "damage.hh"
+#include "stroke.hh"
+
+namespace
+{
+    // What has been drawn, as coverage bytes in square tiles of
+    // `canvas_tile' pixels, surface-local with a top-left origin.  Only
+    // tiles a dab reached exist, so the canvas costs what was drawn rather
+    // than what the window measures, and it outlives resizes.  While a
+    // snapshot is open, the first stamp on each tile records what the tile
+    // held, which the snapshot then shares and the canvas copies, so a
+    // snapshot costs a pointer per tile the stroke reached and nothing for
+    // the rest of the canvas.  The tiles changed since settle() are listed
+    // for repainting and uploading.  Not thread-safe, tiles included.
+    class tile_canvas {
+    public:
+        static constexpr int canvas_tile = 64;
+
+        struct tile {
+            uint8_t coverage[canvas_tile * canvas_tile];
+        };
+        // Column and row of a tile, packed.
+        using key = uint64_t;
+        static constexpr key key_of(uint32_t column, uint32_t row) noexcept {
+            return (static_cast<key>(row) << 32) | column;
+        }
+
+        // The tiles changed while the snapshot was open, as they were before,
+        // null for those that did not exist; restore() brings them back.
+        class snapshot {
+            friend class tile_canvas;
+            std::unordered_map<key, std::shared_ptr<tile>> tiles;
+        };
+
+        // Overlapping dabs keep the larger coverage, as GL_MAX blending did.
+        // Tiles left of or above the surface are never made.
+        void stamp(dab const& d) {
+            auto x0 = std::max(static_cast<int>(std::floor(d.x - d.radius - 1)), 0);
+            auto y0 = std::max(static_cast<int>(std::floor(d.y - d.radius - 1)), 0);
+            auto x1 = static_cast<int>(std::ceil(d.x + d.radius + 1));
+            auto y1 = static_cast<int>(std::ceil(d.y + d.radius + 1));
+            for (int ty = y0 / canvas_tile; ty * canvas_tile < y1; ++ty) {
+                for (int tx = x0 / canvas_tile; tx * canvas_tile < x1; ++tx) {
+                    auto& t = this->writable(key_of(tx, ty));
+                    auto left = tx * canvas_tile;
+                    auto top = ty * canvas_tile;
+                    for (int row = std::max(y0, top); row < std::min(y1, top + canvas_tile); ++row) {
+                        auto line = t.coverage + (row - top) * canvas_tile;
+                        for (int col = std::max(x0, left); col < std::min(x1, left + canvas_tile); ++col) {
+                            auto c = dab_coverage(d, std::hypot(col + 0.5f - d.x, row + 0.5f - d.y));
+                            auto& texel = line[col - left];
+                            texel = std::max(texel, static_cast<uint8_t>(c * 255 + 0.5f));
+                        }
+                    }
+                }
+            }
+        }
+
+        // Opens a snapshot of the canvas as it is now, closing and returning
+        // the one open before, if any.
+        snapshot checkpoint() {
+            auto s = this->close();
+            this->recording = true;
+            return s;
+        }
+        // Closes the open snapshot and returns it; empty if none was open.
+        snapshot close() noexcept {
+            this->recording = false;
+            return std::exchange(this->record, { });
+        }
+        // Puts back just the tiles `s' recorded, and lists them dirty.
+        void restore(snapshot const& s) {
+            for (auto const& [k, t] : s.tiles) {
+                if (t) {
+                    this->tiles[k] = t;
+                }
+                else {
+                    this->tiles.erase(k);
+                }
+                this->changed.push_back(k);
+            }
+        }
+
+        tile const* find(key k) const noexcept {
+            auto it = this->tiles.find(k);
+            return it == this->tiles.end() ? nullptr : it->second.get();
+        }
+        // Every tile, dirty or not.
+        template <class F>
+        void each(F&& f) const {
+            for (auto const& [k, t] : this->tiles) {
+                f(k, *t);
+            }
+        }
+        size_t size() const noexcept { return this->tiles.size(); }
+
+        // Tiles made, stamped or restored since the last settle(), each
+        // once; those restore() dropped are among them, with find() giving
+        // nullptr.
+        std::span<key const> dirty() {
+            std::sort(this->changed.begin(), this->changed.end());
+            this->changed.erase(std::unique(this->changed.begin(), this->changed.end()),
+                                this->changed.end());
+            return this->changed;
+        }
+        void settle() noexcept { this->changed.clear(); }
+
+        // The pixels of tile `k' on a surface `height' high, bottom-left
+        // origin like damage.
+        static rect bounds(key k, int height) noexcept {
+            int left = static_cast<uint32_t>(k) * canvas_tile;
+            int top = static_cast<uint32_t>(k >> 32) * canvas_tile;
+            return { left, height - top - canvas_tile, left + canvas_tile, height - top };
+        }
+
+        // Lays white ink over the rectangle [x0, x1) x [y0, y1) of a top-down
+        // premultiplied ARGB8888 image, like paint() addresses it, which
+        // shows the canvas at `scale' times its resolution.  Runs without
+        // a tile are skipped whole.
+        void composite(uint32_t* pixels, int stride, int x0, int y0, int x1, int y1,
+                       float scale = 1) const noexcept
+        {
+            for (int row = y0; row < y1; ++row) {
+                auto line = pixels + static_cast<size_t>(row) * stride;
+                auto source = static_cast<int>((row + 0.5f) / scale);
+                auto ty = source / canvas_tile;
+                auto offset = (source % canvas_tile) * canvas_tile;
+                for (int col = x0; col < x1; ) {
+                    auto tx = static_cast<int>((col + 0.5f) / scale) / canvas_tile;
+                    // The first column past this tile.
+                    auto end = std::min(static_cast<int>(std::ceil((tx + 1) * canvas_tile * scale - 0.5f)), x1);
+                    end = std::max(end, col + 1);
+                    auto t = this->find(key_of(tx, ty));
+                    for (; t && col < end; ++col) {
+                        auto at = std::min(static_cast<int>((col + 0.5f) / scale) - tx * canvas_tile,
+                                           canvas_tile - 1);
+                        if (uint32_t a = t->coverage[offset + at]) {
+                            auto p = line[col];
+                            auto over = [&](int shift) noexcept {
+                                auto c = (p >> shift) & 0xff;
+                                return (a + c * (255 - a) / 255) << shift;
+                            };
+                            line[col] = over(24) | over(16) | over(8) | over(0);
+                        }
+                    }
+                    col = end;
+                }
+            }
+        }
+
+    private:
+        // The tile at `k' for stamping, its prior state recorded in the open
+        // snapshot the first time: made blank if missing, copied if a
+        // snapshot shares it.
+        tile& writable(key k) {
+            auto& t = this->tiles[k];
+            if (this->recording) {
+                this->record.tiles.try_emplace(k, t);
+            }
+            if (!t) {
+                t = std::make_shared<tile>();
+                this->changed.push_back(k);
+            }
+            else if (t.use_count() > 1) {
+                t = std::make_shared<tile>(*t);
+                this->changed.push_back(k);
+            }
+            else if (this->changed.empty() || this->changed.back() != k) {
+                this->changed.push_back(k);
+            }
+            return *t;
+        }
+
+        std::unordered_map<key, std::shared_ptr<tile>> tiles;
+        std::vector<key> changed;
+        snapshot record;
+        bool recording = false;
+    };
+
+    template <class Ch>
+    auto& operator<<(std::basic_ostream<Ch>& output, tile_canvas const& c) {
+        return output << "canvas: " << c.size() << " tiles, "
+                      << c.size() * sizeof (tile_canvas::tile) / 1024 << " KiB";
+    }
+
+    // Undo as a bounded stack of canvas snapshots, the newest still open on
+    // the canvas.  Each holds only the prior tiles its stroke changed, which
+    // are freed as it drops off the bottom.
+    class canvas_history {
+    public:
+        static constexpr size_t depth = 64;
+
+        // Remembers `canvas' as it is now, before a stroke changes it.
+        void checkpoint(tile_canvas& canvas) {
+            auto s = canvas.checkpoint();
+            if (this->open) {
+                if (this->snapshots.size() == depth - 1) {
+                    this->snapshots.pop_front();
+                }
+                this->snapshots.push_back(std::move(s));
+            }
+            this->open = true;
+        }
+        // Takes `canvas' back to the newest checkpoint; false if none is
+        // left.
+        bool undo(tile_canvas& canvas) {
+            if (this->open) {
+                this->open = false;
+                canvas.restore(canvas.close());
+                return true;
+            }
+            if (this->snapshots.empty()) {
+                return false;
+            }
+            canvas.restore(this->snapshots.back());
+            this->snapshots.pop_back();
+            return true;
+        }
+        size_t size() const noexcept { return this->snapshots.size() + this->open; }
+
+    private:
+        std::deque<tile_canvas::snapshot> snapshots;
+        bool open = false;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_CANVAS_HH_*/
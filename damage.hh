@@ -0,0 +1,149 @@
+#ifndef INCLUDE_DAMAGE_HH_
+#define INCLUDE_DAMAGE_HH_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+namespace
+{
+    // Half-open pixel rectangle with a bottom-left origin, the convention of
+    // gl_FragCoord, glScissor and EGL damage rectangles.
+    struct rect {
+        int x0;
+        int y0;
+        int x1;
+        int y1;
+        bool empty() const noexcept { return this->x0 >= this->x1 || this->y0 >= this->y1; }
+        int width() const noexcept { return this->x1 - this->x0; }
+        int height() const noexcept { return this->y1 - this->y0; }
+    };
+    inline rect unite(rect a, rect b) noexcept {
+        return { std::min(a.x0, b.x0), std::min(a.y0, b.y0),
+                 std::max(a.x1, b.x1), std::max(a.y1, b.y1) };
+    }
+    inline bool touches(rect a, rect b) noexcept {
+        return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+    }
+    // `r' grown by `margin' pixels on every side.
+    inline rect inflate(rect r, int margin) noexcept {
+        return { r.x0 - margin, r.y0 - margin, r.x1 + margin, r.y1 + margin };
+    }
+    // The pixels covering `r' in an image drawn at `scale' times the
+    // resolution `r' is measured in.
+    inline rect scale_rect(rect r, float scale) noexcept {
+        return { static_cast<int>(std::floor(r.x0 * scale)), static_cast<int>(std::floor(r.y0 * scale)),
+                 static_cast<int>(std::ceil(r.x1 * scale)), static_cast<int>(std::ceil(r.y1 * scale)) };
+    }
+    // The square a pointer at (x, y) can darken: smoothstep(16, 40, r) is 1
+    // from 40 px on.
+    inline rect footprint(float x, float y) noexcept {
+        constexpr float reach = 41;
+        return { static_cast<int>(std::floor(x - reach)), static_cast<int>(std::floor(y - reach)),
+                 static_cast<int>(std::ceil(x + reach)), static_cast<int>(std::ceil(y + reach)) };
+    }
+
+    // Damage of the last `depth' presented frames.  A buffer that was last
+    // painted `age' frames ago (EGL_EXT_buffer_age, or the serial of a wl_shm
+    // buffer) needs the union of the newest `age' entries repainted; unknown
+    // or older contents need everything.  All storage is fixed-size.
+    class damage_history {
+    public:
+        static constexpr int depth = 4;
+        static constexpr int max_rects = 32;
+
+        // Starts a new frame of `width' x `height'.  A size change makes the
+        // frame and every older buffer content stale.
+        void next(int width, int height) noexcept {
+            ++this->serial;
+            auto& f = this->frames[this->serial % depth];
+            f.count = 0;
+            f.full = width != this->width || height != this->height;
+            this->width = width;
+            this->height = height;
+        }
+        void add(rect r) noexcept {
+            auto& f = this->frames[this->serial % depth];
+            r = clip(r);
+            if (f.full || r.empty()) {
+                return;
+            }
+            f.count = merge(f.rects.data(), f.count, r);
+            if (f.count > max_rects) {
+                f.full = true;
+            }
+        }
+        void invalidate() noexcept { this->frames[this->serial % depth].full = true; }
+
+        uint64_t current_serial() const noexcept { return this->serial; }
+        // What changed in the current frame, for the compositor.
+        std::span<rect const> current() noexcept {
+            auto& f = this->frames[this->serial % depth];
+            return f.full ? this->whole() : std::span<rect const>(f.rects.data(), f.count);
+        }
+        // What must be repainted into a buffer whose content is `age' frames
+        // old, 0 meaning unknown.
+        std::span<rect const> region(uint64_t age) noexcept {
+            if (age == 0 || age > depth || age > this->serial) {
+                return this->whole();
+            }
+            int count = 0;
+            for (uint64_t i = 0; i < age; ++i) {
+                auto& f = this->frames[(this->serial - i) % depth];
+                if (f.full) {
+                    return this->whole();
+                }
+                for (int j = 0; j < f.count; ++j) {
+                    count = merge(this->scratch.data(), count, f.rects[j]);
+                    if (count > max_rects) {
+                        return this->whole();
+                    }
+                }
+            }
+            return { this->scratch.data(), static_cast<size_t>(count) };
+        }
+
+    private:
+        struct frame {
+            bool full = true;
+            int count = 0;
+            std::array<rect, max_rects + 1> rects;
+        };
+        rect clip(rect r) const noexcept {
+            return { std::max(r.x0, 0), std::max(r.y0, 0),
+                     std::min(r.x1, this->width), std::min(r.y1, this->height) };
+        }
+        // Folds `r' into the `count' rectangles at `rects', uniting it with
+        // every one it touches, and returns the new count.  `rects' must have
+        // room for one more.
+        static int merge(rect* rects, int count, rect r) noexcept {
+            for (int i = 0; i < count; ) {
+                if (touches(rects[i], r)) {
+                    r = unite(r, rects[i]);
+                    rects[i] = rects[--count];
+                    i = 0;
+                }
+                else {
+                    ++i;
+                }
+            }
+            rects[count] = r;
+            return count + 1;
+        }
+        std::span<rect const> whole() noexcept {
+            this->everything = { 0, 0, this->width, this->height };
+            return { &this->everything, 1 };
+        }
+
+        uint64_t serial = 0;
+        int width = 0;
+        int height = 0;
+        std::array<frame, depth> frames;
+        std::array<rect, max_rects + 1> scratch;
+        rect everything;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_DAMAGE_HH_*/
@@ -0,0 +1,88 @@
+#ifndef INCLUDE_DISPATCH_HH_
+#define INCLUDE_DISPATCH_HH_
+
+#include <cerrno>
+#include <functional>
+#include <thread>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+
+#include <wayland-client.h>
+
+#include "safe.hh"
+#include "trace.hh"
+
+namespace
+{
+    // Dispatches one wl_event_queue on a thread of its own until destroyed,
+    // so a busy queue never holds up the others.  `idle' runs on that thread
+    // each time the queue has been drained, right before it blocks again.
+    // The thread goes by `name' in traces.
+    class queue_thread {
+    public:
+        queue_thread(wl_display* display, wl_event_queue* queue, char const* name,
+                     std::function<void()> idle = { })
+            : stop{eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)},
+              thread{[=, this](std::stop_token token) {
+                  tracer::instance().name_thread(name);
+                  this->loop(token, display, queue, idle);
+              }}
+            {
+            }
+        queue_thread(queue_thread const&) = delete;
+        queue_thread& operator=(queue_thread const&) = delete;
+
+    private:
+        void loop(std::stop_token token, wl_display* display, wl_event_queue* queue,
+                  std::function<void()> const& idle) noexcept
+        {
+            std::stop_callback wake(token, [this]() noexcept {
+                eventfd_write(this->stop.get(), 1);
+            });
+            pollfd fds[] = {
+                { wl_display_get_fd(display), POLLIN, 0 },
+                { this->stop.get(), POLLIN, 0 },
+            };
+            auto dispatch = [&]() noexcept {
+                trace_scope scope("dispatch");
+                return wl_display_dispatch_queue_pending(display, queue) != -1;
+            };
+            for (;;) {
+                while (wl_display_prepare_read_queue(display, queue) != 0) {
+                    if (!dispatch()) {
+                        return;
+                    }
+                }
+                if (idle) {
+                    idle();
+                }
+                wl_display_flush(display);
+                if (poll(fds, 2, -1) == -1 && errno != EINTR) {
+                    wl_display_cancel_read(display);
+                    return;
+                }
+                if (token.stop_requested()) {
+                    wl_display_cancel_read(display);
+                    return;
+                }
+                if (fds[0].revents & POLLIN) {
+                    if (wl_display_read_events(display) == -1) {
+                        return;
+                    }
+                }
+                else {
+                    wl_display_cancel_read(display);
+                }
+                if (!dispatch()) {
+                    return;
+                }
+            }
+        }
+
+        safe_fd stop;
+        std::jthread thread;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_DISPATCH_HH_*/
@@ -0,0 +1,188 @@
+#ifndef INCLUDE_EGL_HH_
+#define INCLUDE_EGL_HH_
+
+#include <array>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <utility>
+
+#include <wayland-client.h>
+#include <wayland-egl.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "safe.hh"
+#include "damage.hh"
+#include "trace.hh"
+
+namespace
+{
+    template <auto destroy>
+    struct egl_deleter {
+        EGLDisplay display = EGL_NO_DISPLAY;
+        void operator()(void* ptr) const noexcept { destroy(this->display, ptr); }
+    };
+    template <auto destroy>
+    auto safe_egl_ptr(EGLDisplay display, void* ptr, location loc = location::current()) {
+        if (!ptr) {
+            throw fatal_error("bad pointer", loc);
+        }
+        return std::unique_ptr<void, egl_deleter<destroy>>(ptr, egl_deleter<destroy>{display});
+    }
+
+    inline bool has_extension(char const* extensions, char const* name) noexcept {
+        auto length = std::strlen(name);
+        for (auto p = extensions; p && (p = std::strstr(p, name)); p += length) {
+            if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // The part of EGL setup that needs no surface: display initialization,
+    // config choice and a GLES 3 context.  It may be made on any thread and
+    // handed to an egl_target, which makes the context current on its own.
+    // share() makes further contexts on the same display that share
+    // programs, buffers and textures with this one, one per thread that
+    // draws; the display is terminated with the last of them.
+    class egl_context {
+    public:
+        explicit egl_context(wl_display* wl, location loc = location::current())
+            : display{safe_ptr(eglGetDisplay(wl), eglTerminate, loc)}
+            {
+                eglInitialize(this->display.get(), nullptr, nullptr);
+                eglBindAPI(EGL_OPENGL_ES_API);
+                EGLint num_config;
+                eglChooseConfig(this->display.get(),
+                                std::array<EGLint, 15>(
+                                    {
+                                        EGL_LEVEL, 0,
+                                        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+                                        EGL_RED_SIZE, 8,
+                                        EGL_GREEN_SIZE, 8,
+                                        EGL_BLUE_SIZE, 8,
+                                        EGL_ALPHA_SIZE, 8,
+                                        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
+                                        EGL_NONE,
+                                    }
+                                ).data(),
+                                &this->config, 1, &num_config);
+                this->context = create(this->display.get(), this->config, EGL_NO_CONTEXT, loc);
+            }
+
+        egl_context share(location loc = location::current()) const {
+            return egl_context(this->display, this->config,
+                               create(this->display.get(), this->config, this->context.get(), loc));
+        }
+
+    private:
+        friend class egl_target;
+        using context_ptr = std::unique_ptr<void, egl_deleter<eglDestroyContext>>;
+
+        egl_context(std::shared_ptr<void> display, EGLConfig config, context_ptr context) noexcept
+            : display{std::move(display)}, config{config}, context{std::move(context)}
+            {
+            }
+        static context_ptr create(EGLDisplay display, EGLConfig config, EGLContext share,
+                                  location loc)
+        {
+            return safe_egl_ptr<eglDestroyContext>(
+                display,
+                eglCreateContext(display,
+                                 config,
+                                 share,
+                                 std::array<EGLint, 3>(
+                                     {
+                                         EGL_CONTEXT_CLIENT_VERSION, 3,
+                                         EGL_NONE,
+                                     }
+                                 ).data()),
+                loc);
+        }
+
+        std::shared_ptr<void> display;
+        EGLConfig config = nullptr;
+        context_ptr context;
+    };
+
+    // An EGL window surface on `surface' with the context of an egl_context
+    // made current on the calling thread.  Where the driver allows, it
+    // reports how old the back buffer's contents are and passes damage on to
+    // the compositor.
+    class egl_target {
+    public:
+        egl_target(egl_context context, wl_surface* surface, int width, int height,
+                   location loc = location::current())
+            : context{std::move(context)},
+              window{safe_ptr(wl_egl_window_create(surface, width, height),
+                              wl_egl_window_destroy, loc)}
+            {
+                auto display = this->context.display.get();
+                eglBindAPI(EGL_OPENGL_ES_API);
+                this->surface = safe_egl_ptr<eglDestroySurface>(
+                    display,
+                    eglCreateWindowSurface(display,
+                                           this->context.config,
+                                           this->window.get(),
+                                           nullptr),
+                    loc);
+                eglMakeCurrent(display,
+                               this->surface.get(), this->surface.get(),
+                               this->context.context.get());
+                auto extensions = eglQueryString(display, EGL_EXTENSIONS);
+                this->has_buffer_age = has_extension(extensions, "EGL_EXT_buffer_age");
+                if (has_extension(extensions, "EGL_KHR_swap_buffers_with_damage")) {
+                    this->swap_with_damage = reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(
+                        eglGetProcAddress("eglSwapBuffersWithDamageKHR"));
+                }
+                else if (has_extension(extensions, "EGL_EXT_swap_buffers_with_damage")) {
+                    this->swap_with_damage = reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC>(
+                        eglGetProcAddress("eglSwapBuffersWithDamageEXT"));
+                }
+            }
+        ~egl_target() noexcept {
+            eglMakeCurrent(this->egl_display(), EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        }
+
+        void resize(int width, int height) noexcept {
+            wl_egl_window_resize(this->window.get(), width, height, 0, 0);
+        }
+        void swap() noexcept { eglSwapBuffers(this->egl_display(), this->surface.get()); }
+        // Swaps, telling the compositor only `damage' changed.
+        void swap(std::span<rect const> damage) noexcept {
+            trace_scope scope("eglSwapBuffers");
+            if (!this->swap_with_damage || damage.size() > damage_history::max_rects) {
+                return this->swap();
+            }
+            std::array<EGLint, 4 * damage_history::max_rects> rects;
+            for (size_t i = 0; i < damage.size(); ++i) {
+                rects[4 * i + 0] = damage[i].x0;
+                rects[4 * i + 1] = damage[i].y0;
+                rects[4 * i + 2] = damage[i].width();
+                rects[4 * i + 3] = damage[i].height();
+            }
+            this->swap_with_damage(this->egl_display(), this->surface.get(),
+                                   rects.data(), damage.size());
+        }
+        // Frames since the back buffer was last drawn, 0 when unknown.
+        int buffer_age() const noexcept {
+            EGLint age = 0;
+            if (this->has_buffer_age) {
+                eglQuerySurface(this->egl_display(), this->surface.get(), EGL_BUFFER_AGE_EXT, &age);
+            }
+            return age;
+        }
+        EGLDisplay egl_display() const noexcept { return this->context.display.get(); }
+
+    private:
+        egl_context context;
+        std::unique_ptr<wl_egl_window, decltype (&wl_egl_window_destroy)> window;
+        std::unique_ptr<void, egl_deleter<eglDestroySurface>> surface;
+        bool has_buffer_age = false;
+        PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swap_with_damage = nullptr;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_EGL_HH_*/
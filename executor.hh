@@ -0,0 +1,319 @@
+#ifndef INCLUDE_EXECUTOR_HH_
+#define INCLUDE_EXECUTOR_HH_
+
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+
+#include "safe.hh"
+#include "task.hh"
+#include "trace.hh"
+
+namespace
+{
+    // Single-threaded coroutine executor around one epoll instance.  The
+    // display's default queue, or the queue it is given, is dispatched by
+    // the loop itself, so executors on several threads can share one
+    // connection, each driving the proxies on its own queue; coroutines
+    // suspend on Wayland events (callbacks, notifications raised by
+    // listeners) or on file descriptors, and are resumed from the loop, never
+    // from inside a listener, so they may freely issue requests or await
+    // again.  Every awaitable sends its request when it is created, not when
+    // it is awaited, so a coroutine can start several round trips, do CPU
+    // work, and only then wait for the answers.
+    class executor {
+        struct waiter {
+            std::coroutine_handle<> handle;
+            int fd;
+        };
+
+    public:
+        explicit executor(wl_display* display, wl_event_queue* queue = nullptr)
+            : display{display},
+              queue{queue},
+              epoll{epoll_create1(EPOLL_CLOEXEC)}
+            {
+                if (queue) {
+                    // Round trips are answered on the queue too.
+                    this->sync_proxy.reset(static_cast<wl_display*>(wl_proxy_create_wrapper(display)));
+                    wl_proxy_set_queue(reinterpret_cast<wl_proxy*>(this->sync_proxy.get()), queue);
+                }
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.ptr = nullptr; // the display
+                if (epoll_ctl(this->epoll.get(), EPOLL_CTL_ADD, wl_display_get_fd(display), &ev) == -1) {
+                    throw fatal_error("cannot watch the display", location::current());
+                }
+            }
+        ~executor() noexcept {
+            // Suspended coroutines own Wayland objects; they go before the
+            // display does.
+            this->tasks.clear();
+        }
+        executor(executor const&) = delete;
+        executor& operator=(executor const&) = delete;
+
+        wl_display* get_display() const noexcept { return this->display; }
+
+        // Starts `t' on the next turn of the loop; the executor owns it from
+        // then on.
+        void spawn(task<void> t) {
+            this->post(t.coroutine());
+            this->tasks.push_back(std::move(t));
+        }
+        void post(std::coroutine_handle<> handle) noexcept { this->ready.push_back(handle); }
+        void stop() noexcept { this->running = false; }
+
+        // Runs until stop() or until the connection is lost.  Exceptions
+        // escaping a coroutine leave through here.
+        void run() {
+            this->running = true;
+            while (this->running) {
+                this->resume_ready();
+                if (!this->running) {
+                    break;
+                }
+                if ((this->queue ? wl_display_prepare_read_queue(this->display, this->queue)
+                                 : wl_display_prepare_read(this->display)) != 0)
+                {
+                    if (!this->dispatch()) {
+                        return;
+                    }
+                    continue;
+                }
+                wl_display_flush(this->display);
+                epoll_event events[16];
+                auto n = epoll_wait(this->epoll.get(), events, 16, -1);
+                if (n == -1) {
+                    wl_display_cancel_read(this->display);
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw fatal_error("epoll_wait failed", location::current());
+                }
+                bool incoming = false;
+                for (int i = 0; i < n; ++i) {
+                    if (auto w = static_cast<waiter*>(events[i].data.ptr)) {
+                        epoll_ctl(this->epoll.get(), EPOLL_CTL_DEL, w->fd, nullptr);
+                        this->post(w->handle);
+                    }
+                    else {
+                        incoming = true;
+                    }
+                }
+                if (incoming) {
+                    if (wl_display_read_events(this->display) == -1) {
+                        return;
+                    }
+                }
+                else {
+                    wl_display_cancel_read(this->display);
+                }
+                if (!this->dispatch()) {
+                    return;
+                }
+            }
+        }
+
+        // Resumes when `fd' becomes readable.
+        class readiness {
+        public:
+            readiness(executor& ex, int fd) noexcept : ex{ex}, w{{}, fd} { }
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) {
+                this->w.handle = handle;
+                epoll_event ev{};
+                ev.events = EPOLLIN | EPOLLONESHOT;
+                ev.data.ptr = &this->w;
+                if (epoll_ctl(this->ex.epoll.get(), EPOLL_CTL_ADD, this->w.fd, &ev) == -1) {
+                    throw fatal_error("cannot watch a descriptor", location::current());
+                }
+            }
+            void await_resume() const noexcept { }
+        private:
+            executor& ex;
+            waiter w;
+        };
+        auto readable(int fd) noexcept { return readiness(*this, fd); }
+
+        // Resumes after `duration', through a timerfd armed on creation.
+        class timer {
+        public:
+            timer(executor& ex, std::chrono::nanoseconds duration)
+                : fd{timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)},
+                  wait{ex, fd.get()}
+                {
+                    itimerspec spec{};
+                    spec.it_value.tv_sec = duration.count() / 1'000'000'000;
+                    spec.it_value.tv_nsec = duration.count() % 1'000'000'000;
+                    if (!spec.it_value.tv_sec && !spec.it_value.tv_nsec) {
+                        spec.it_value.tv_nsec = 1; // zero would disarm it
+                    }
+                    timerfd_settime(this->fd.get(), 0, &spec, nullptr);
+                }
+            bool await_ready() const noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> handle) { this->wait.await_suspend(handle); }
+            void await_resume() const noexcept { }
+        private:
+            safe_fd fd;
+            readiness wait;
+        };
+        auto sleep_for(std::chrono::nanoseconds duration) { return timer(*this, duration); }
+
+        // Resumes once the eventfd `fd' was signalled, and yields its count.
+        class counter {
+        public:
+            counter(executor& ex, int fd) noexcept : fd{fd}, wait{ex, fd} { }
+            bool await_ready() noexcept { return eventfd_read(this->fd, &this->count) == 0; }
+            void await_suspend(std::coroutine_handle<> handle) { this->wait.await_suspend(handle); }
+            eventfd_t await_resume() noexcept {
+                if (!this->count) {
+                    eventfd_read(this->fd, &this->count);
+                }
+                return this->count;
+            }
+        private:
+            int fd;
+            eventfd_t count = 0;
+            readiness wait;
+        };
+        auto signalled(int fd) noexcept { return counter(*this, fd); }
+
+        // Resumes on wl_callback.done, yielding its data: frame callbacks,
+        // and wl_display.sync for round trips.
+        class callback {
+        public:
+            callback(executor& ex, wl_callback* proxy)
+                : ex{ex},
+                  proxy{safe_ptr(proxy, wl_callback_destroy)}
+                {
+                    wl_callback_add_listener(proxy, &listener, this);
+                }
+            callback(callback const&) = delete;
+            callback& operator=(callback const&) = delete;
+            auto operator co_await() noexcept {
+                struct awaiter {
+                    callback& self;
+                    bool await_ready() const noexcept { return this->self.fired; }
+                    void await_suspend(std::coroutine_handle<> handle) noexcept {
+                        this->self.handle = handle;
+                    }
+                    uint32_t await_resume() const noexcept { return this->self.data; }
+                };
+                return awaiter{*this};
+            }
+        private:
+            static void done(void* data, wl_callback*, uint32_t value) noexcept {
+                auto self = static_cast<callback*>(data);
+                self->fired = true;
+                self->data = value;
+                if (self->handle) {
+                    self->ex.post(self->handle);
+                }
+            }
+            static constexpr wl_callback_listener listener = { done };
+
+            executor& ex;
+            std::unique_ptr<wl_callback, void (*)(wl_callback*)> proxy;
+            std::coroutine_handle<> handle;
+            bool fired = false;
+            uint32_t data = 0;
+        };
+        // The awaitable form of wl_display_roundtrip: every event the
+        // compositor sent before answering has been dispatched on resumption.
+        auto roundtrip() {
+            auto proxy = wl_display_sync(this->sync_proxy ? this->sync_proxy.get() : this->display);
+            wl_display_flush(this->display);
+            return callback(*this, proxy);
+        }
+        auto frame(wl_surface* surface) { return callback(*this, wl_surface_frame(surface)); }
+
+        // Resumes after the next batch of events on the executor's queue has
+        // been dispatched, for state that only a listener can change.
+        auto dispatched() noexcept {
+            struct awaiter {
+                executor& ex;
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> handle) {
+                    this->ex.after_dispatch.push_back(handle);
+                }
+                void await_resume() const noexcept { }
+            };
+            return awaiter{*this};
+        }
+
+    private:
+        void resume_ready() {
+            while (!this->ready.empty()) {
+                auto handle = this->ready.front();
+                this->ready.pop_front();
+                handle.resume();
+            }
+            std::erase_if(this->tasks, [](auto const& t) noexcept { return t.done(); });
+        }
+        bool dispatch() {
+            trace_scope scope("dispatch");
+            if ((this->queue ? wl_display_dispatch_queue_pending(this->display, this->queue)
+                             : wl_display_dispatch_pending(this->display)) == -1)
+            {
+                return false;
+            }
+            for (auto handle : this->after_dispatch) {
+                this->post(handle);
+            }
+            this->after_dispatch.clear();
+            return true;
+        }
+
+        wl_display* display;
+        wl_event_queue* queue;
+        std::unique_ptr<wl_display, void (*)(void*)> sync_proxy{nullptr, wl_proxy_wrapper_destroy};
+        safe_fd epoll;
+        bool running = false;
+        std::deque<std::coroutine_handle<>> ready;
+        std::vector<std::coroutine_handle<>> after_dispatch;
+        std::vector<task<void>> tasks;
+    };
+
+    // A level that listeners raise and coroutines wait for, such as "the
+    // surface was configured" or "there is something to draw".  Every waiter
+    // is resumed by the next notify().
+    class notification {
+    public:
+        explicit notification(executor& ex) noexcept : ex{ex} { }
+        notification(notification const&) = delete;
+        notification& operator=(notification const&) = delete;
+        void notify() noexcept {
+            for (auto handle : this->waiters) {
+                this->ex.post(handle);
+            }
+            this->waiters.clear();
+        }
+        auto operator co_await() noexcept {
+            struct awaiter {
+                notification& self;
+                bool await_ready() const noexcept { return false; }
+                void await_suspend(std::coroutine_handle<> handle) {
+                    this->self.waiters.push_back(handle);
+                }
+                void await_resume() const noexcept { }
+            };
+            return awaiter{*this};
+        }
+    private:
+        executor& ex;
+        std::vector<std::coroutine_handle<>> waiters;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_EXECUTOR_HH_*/
@@ -0,0 +1,79 @@
+#ifndef INCLUDE_FIELD_HH_
+#define INCLUDE_FIELD_HH_
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#include "points.hh"
+
+namespace
+{
+    // Everything the brightness field depends on, trivially copyable so it
+    // can be captured by value in a SYCL kernel.  The points and their tile
+    // lists (see tile_bins) are referenced, not copied, and must be
+    // reachable wherever the field is evaluated.
+    struct field_params {
+        float resolution[2];
+        int tile_columns;
+        size_t point_count;
+        float const* x;
+        float const* y;
+        size_t cell_count;
+        uint32_t const* cells;
+    };
+
+    inline float smoothstep(float edge0, float edge1, float x) noexcept {
+        auto t = (x - edge0) / (edge1 - edge0);
+        t = t < 0 ? 0 : t > 1 ? 1 : t;
+        return t * t * (3 - 2 * t);
+    }
+
+    // The fragment shader's vignette x smoothstep field at pixel centre
+    // (x, y), measured from the bottom-left corner like gl_FragCoord.  Only
+    // the points binned into the pixel's tile can darken it.
+    inline float brightness(float x, float y, field_params const& p) noexcept {
+        auto dx = x - p.resolution[0] / 2;
+        auto dy = y - p.resolution[1] / 2;
+        auto level = 1 - std::sqrt(dx * dx + dy * dy) /
+            std::sqrt(p.resolution[0] * p.resolution[0] + p.resolution[1] * p.resolution[1]);
+        auto tile = static_cast<size_t>(y / tile_size) * p.tile_columns +
+            static_cast<size_t>(x / tile_size);
+        for (auto i = p.cells[tile]; i < p.cells[tile + 1]; ++i) {
+            auto k = p.cells[i];
+            auto px = p.x[k] - x;
+            auto py = p.y[k] - y;
+            level *= smoothstep(16, 40, std::sqrt(px * px + py * py));
+        }
+        return level < 0 ? 0 : level;
+    }
+
+    // (0, 0, b, b) as RGBA8 in memory order, the layout GL uploads.
+    inline uint32_t shade(float x, float y, field_params const& p) noexcept {
+        auto level = static_cast<uint32_t>(brightness(x, y, p) * 255 + 0.5f);
+        return (level << 16) | (level << 24);
+    }
+
+    // The same colour as premultiplied WL_SHM_FORMAT_ARGB8888.
+    inline uint32_t shade_argb(float x, float y, field_params const& p) noexcept {
+        auto level = static_cast<uint32_t>(brightness(x, y, p) * 255 + 0.5f);
+        return level | (level << 24);
+    }
+
+    // CPU renderer: writes the rectangle [x0, x1) x [y0, y1) of a top-down
+    // ARGB8888 image `height' rows high with `stride' pixels per row, which
+    // shows the window at `scale' times its resolution.
+    inline void paint(uint32_t* pixels, int stride, int height, field_params const& p,
+                      int x0, int y0, int x1, int y1, float scale = 1) noexcept
+    {
+        for (int row = y0; row < y1; ++row) {
+            auto line = pixels + static_cast<size_t>(row) * stride;
+            auto y = (height - row - 0.5f) / scale;
+            for (int col = x0; col < x1; ++col) {
+                line[col] = shade_argb((col + 0.5f) / scale, y, p);
+            }
+        }
+    }
+} // ::(anonymous)
+
+#endif/*INCLUDE_FIELD_HH_*/
@@ -0,0 +1,170 @@
+#ifndef INCLUDE_GOVERNOR_HH_
+#define INCLUDE_GOVERNOR_HH_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+
+#include <GLES3/gl3.h>
+#include <GLES2/gl2ext.h>
+#include <EGL/egl.h>
+
+#include "egl.hh"
+
+namespace
+{
+    // Picks the fraction of the window's resolution to render at, so that
+    // frames fit the budget of `target_fps'.  Frame times are smoothed; a
+    // few frames in a row over 90% of the budget shrink the scale by as much
+    // as should bring them to 80%, the cost going with the pixel count, and
+    // a long stretch under 60% grows it a step at a time, so a single hitch
+    // neither blurs the picture nor makes it pump.  Scales are multiples of
+    // 1/16, which keeps the offscreen targets from being reallocated for
+    // every small change.
+    class resolution_governor {
+    public:
+        static constexpr float min_scale = 0.25f;
+        static constexpr float step = 1.0f / 16;
+
+        explicit resolution_governor(double target_fps) noexcept
+            : budget{1000 / target_fps}
+            {
+            }
+
+        // Feeds the duration of a frame in milliseconds; true when scale()
+        // changed.
+        bool add(double ms) noexcept {
+            this->smoothed = this->smoothed ? 0.8 * this->smoothed + 0.2 * ms : ms;
+            if (this->smoothed > 0.9 * this->budget) {
+                this->calm = 0;
+                if (++this->strained < 3) {
+                    return false;
+                }
+                auto wanted = this->level * static_cast<float>(std::sqrt(0.8 * this->budget / this->smoothed));
+                return this->set(std::min(std::floor(wanted / step) * step, this->level - step));
+            }
+            this->strained = 0;
+            if (this->smoothed < 0.6 * this->budget) {
+                if (++this->calm < 30) {
+                    return false;
+                }
+                return this->set(this->level + step);
+            }
+            this->calm = 0;
+            return false;
+        }
+        // Back to full resolution, for a window that stopped drawing.
+        bool reset() noexcept { return this->set(1); }
+
+        float scale() const noexcept { return this->level; }
+        float lowest() const noexcept { return this->floor; }
+        double budget_ms() const noexcept { return this->budget; }
+        // `size' pixels of the window at the current scale.
+        int scaled(int size) const noexcept {
+            return std::max(static_cast<int>(std::ceil(size * this->level)), 1);
+        }
+
+    private:
+        bool set(float s) noexcept {
+            s = std::clamp(s, min_scale, 1.0f);
+            this->strained = 0;
+            this->calm = 0;
+            if (s == this->level) {
+                return false;
+            }
+            this->smoothed *= (s * s) / (this->level * this->level);
+            this->level = s;
+            this->floor = std::min(this->floor, s);
+            return true;
+        }
+
+        double budget;
+        double smoothed = 0;
+        float level = 1;
+        float floor = 1;
+        int strained = 0; // frames in a row over budget
+        int calm = 0;     // frames in a row well under it
+    };
+
+    template <class Ch>
+    auto& operator<<(std::basic_ostream<Ch>& output, resolution_governor const& g) {
+        return output << "resolution: scale " << g.scale() << ", lowest " << g.lowest()
+                      << ", budget " << g.budget_ms() << " ms";
+    }
+
+    // GPU time of what is drawn between begin() and end(), from
+    // GL_EXT_disjoint_timer_query.  Results are collected a few frames
+    // later, only once available, so timing never stalls the pipeline; a
+    // frame is left untimed when every query is still in flight, and one
+    // the driver reports as disjoint is dropped.  Without the extension it
+    // measures nothing.  Needs the GL context current.
+    class gpu_timer {
+    public:
+        gpu_timer() noexcept {
+            auto extensions = reinterpret_cast<char const*>(glGetString(GL_EXTENSIONS));
+            if (!has_extension(extensions, "GL_EXT_disjoint_timer_query")) {
+                return;
+            }
+            this->result = reinterpret_cast<PFNGLGETQUERYOBJECTUI64VEXTPROC>(
+                eglGetProcAddress("glGetQueryObjectui64vEXT"));
+            if (this->result) {
+                glGenQueries(depth, this->queries.data());
+            }
+        }
+        ~gpu_timer() noexcept {
+            if (this->result) {
+                glDeleteQueries(depth, this->queries.data());
+            }
+        }
+        gpu_timer(gpu_timer const&) = delete;
+        gpu_timer& operator=(gpu_timer const&) = delete;
+
+        void begin() noexcept {
+            this->timing = this->result && this->issued - this->collected < depth;
+            if (this->timing) {
+                glBeginQuery(GL_TIME_ELAPSED_EXT, this->queries[this->issued % depth]);
+            }
+        }
+        void end() noexcept {
+            if (this->timing) {
+                glEndQuery(GL_TIME_ELAPSED_EXT);
+                ++this->issued;
+            }
+        }
+        // The newest finished measurement in milliseconds, 0 when none came
+        // in since the last call.
+        double collect() noexcept {
+            double ms = 0;
+            while (this->collected < this->issued) {
+                auto query = this->queries[this->collected % depth];
+                GLuint available = 0;
+                glGetQueryObjectuiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available) {
+                    break;
+                }
+                GLint disjoint = 0;
+                glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+                GLuint64 ns = 0;
+                this->result(query, GL_QUERY_RESULT, &ns);
+                if (!disjoint) {
+                    ms = ns * 1e-6;
+                }
+                ++this->collected;
+            }
+            return ms;
+        }
+
+    private:
+        static constexpr int depth = 4;
+
+        PFNGLGETQUERYOBJECTUI64VEXTPROC result = nullptr;
+        std::array<GLuint, depth> queries = { };
+        uint64_t issued = 0;
+        uint64_t collected = 0;
+        bool timing = false;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_GOVERNOR_HH_*/
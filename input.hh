@@ -0,0 +1,124 @@
+#ifndef INCLUDE_INPUT_HH_
+#define INCLUDE_INPUT_HH_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+
+namespace
+{
+    constexpr size_t cache_line_size = 64;
+
+    // Wait-free ring for exactly one producer thread and one consumer thread.
+    // Each side keeps its own index and a cached copy of the other side's on
+    // a cache line of its own, so the hot path touches shared lines only when
+    // the cached view says the ring is full (producer) or empty (consumer).
+    template <class T, size_t N>
+    class spsc_ring {
+        static_assert(N && (N & (N - 1)) == 0, "capacity must be a power of two");
+    public:
+        bool try_push(T const& item) noexcept {
+            auto tail = this->tail.load(std::memory_order_relaxed);
+            if (tail - this->head_cache == N) {
+                this->head_cache = this->head.load(std::memory_order_acquire);
+                if (tail - this->head_cache == N) {
+                    return false;
+                }
+            }
+            this->items[tail & (N - 1)] = item;
+            this->tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+        // Drops and counts the record when the consumer has fallen N behind.
+        bool push(T const& item) noexcept {
+            if (this->try_push(item)) {
+                return true;
+            }
+            this->overruns.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        // Hands every record published so far to `f' and releases them all
+        // with a single store, so a frame drains the ring in one pass.
+        template <class F>
+        size_t drain(F&& f) noexcept {
+            auto head = this->head.load(std::memory_order_relaxed);
+            this->tail_cache = this->tail.load(std::memory_order_acquire);
+            for (auto i = head; i != this->tail_cache; ++i) {
+                f(this->items[i & (N - 1)]);
+            }
+            this->head.store(this->tail_cache, std::memory_order_release);
+            return this->tail_cache - head;
+        }
+        uint64_t dropped() const noexcept { return this->overruns.load(std::memory_order_relaxed); }
+
+    private:
+        alignas(cache_line_size) std::atomic<size_t> head = 0; // consumer
+        size_t tail_cache = 0;
+        alignas(cache_line_size) std::atomic<size_t> tail = 0; // producer
+        size_t head_cache = 0;
+        std::atomic<uint64_t> overruns = 0; // producer counts, any thread reports
+        alignas(cache_line_size) T items[N];
+    };
+
+    enum class input_kind : uint16_t {
+        key,
+        pointer_motion,
+        pointer_button,
+        pointer_axis,
+        pointer_axis_source,
+        pointer_axis_stop,
+        pointer_axis_discrete,
+        pointer_frame,
+        touch_down,
+        touch_up,
+        touch_motion,
+        touch_frame,
+        touch_cancel,
+        tool_proximity_in,
+        tool_proximity_out,
+        tool_down,
+        tool_up,
+        tool_motion,
+        tool_pressure,
+        tool_distance,
+        tool_tilt,
+        tool_rotation,
+        tool_slider,
+        tool_wheel,
+        tool_button,
+        tool_frame,
+        key_modifiers,
+        key_repeat_info,
+        keyboard_leave,
+    };
+
+    // One normalized input record: coordinates are surface-local pixels as
+    // floats, `stamp' is CLOCK_MONOTONIC at receipt and `time' the
+    // compositor's millisecond timestamp when the event carries one.  Axis,
+    // tilt, rotation and wheel values travel in x (and y) as plain floats.
+    // Modifiers travel as a keysym_table modifier state, repeat info as the
+    // rate in value and the delay in id.  `window' is the index of the
+    // window the record went to, so a replay can send it there again.
+    struct input_event {
+        uint64_t stamp;
+        uint32_t time;
+        input_kind kind;
+        uint16_t window;
+        int32_t id;     // touch id, tool id, key or button code, discrete steps
+        uint32_t value; // key/button state, axis, axis source, pressure, distance
+        float x;
+        float y;
+    };
+    static_assert(sizeof (input_event) == 32);
+
+    inline uint64_t monotonic_ns() noexcept {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+    }
+
+    using input_ring = spsc_ring<input_event, 4096>;
+} // ::(anonymous)
+
+#endif/*INCLUDE_INPUT_HH_*/
@@ -0,0 +1,158 @@
+#ifndef INCLUDE_KEYBOARD_HH_
+#define INCLUDE_KEYBOARD_HH_
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <sys/mman.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <xkbcommon/xkbcommon.h>
+
+#include "safe.hh"
+
+namespace
+{
+    // Every keysym the keymap can produce, by key and modifier state, worked
+    // out by xkbcommon once per keymap.  The keymap is compiled straight from
+    // the compositor's read-only mapping and the mapping dropped right after;
+    // after that a key is one table load.  Only the modifiers that usually
+    // pick a level are distinguished, and only the first layout is used.
+    class keysym_table {
+    public:
+        static constexpr int mod_bits = 4; // Shift, Lock, Control, Mod1
+        static constexpr uint32_t control = 1u << 2; // in modifiers()
+
+        keysym_table(int fd, uint32_t size, location loc = location::current()) {
+            safe_fd file(fd);
+            auto map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map == MAP_FAILED) {
+                throw fatal_error("cannot map the keymap", loc);
+            }
+            auto context = std::unique_ptr<xkb_context, decltype (&xkb_context_unref)>(
+                xkb_context_new(XKB_CONTEXT_NO_FLAGS), xkb_context_unref);
+            // The string the compositor sends is NUL-terminated; the size
+            // counts the terminator.
+            auto keymap = std::unique_ptr<xkb_keymap, decltype (&xkb_keymap_unref)>(
+                context ? xkb_keymap_new_from_buffer(context.get(), static_cast<char const*>(map),
+                                                     size ? size - 1 : 0,
+                                                     XKB_KEYMAP_FORMAT_TEXT_V1,
+                                                     XKB_KEYMAP_COMPILE_NO_FLAGS)
+                        : nullptr,
+                xkb_keymap_unref);
+            ::munmap(map, size);
+            if (!keymap) {
+                throw fatal_error("cannot compile the keymap", loc);
+            }
+            char const* names[] = {
+                XKB_MOD_NAME_SHIFT, XKB_MOD_NAME_CAPS, XKB_MOD_NAME_CTRL, XKB_MOD_NAME_ALT,
+            };
+            for (int i = 0; i < mod_bits; ++i) {
+                auto index = xkb_keymap_mod_get_index(keymap.get(), names[i]);
+                this->masks[i] = index == XKB_MOD_INVALID ? 0 : uint32_t{1} << index;
+            }
+            this->min = xkb_keymap_min_keycode(keymap.get());
+            auto max = xkb_keymap_max_keycode(keymap.get());
+            auto count = max >= this->min ? max - this->min + 1 : 0;
+            this->syms.assign(static_cast<size_t>(count) << mod_bits, XKB_KEY_NoSymbol);
+            this->repeating.assign(count, false);
+            auto state = std::unique_ptr<xkb_state, decltype (&xkb_state_unref)>(
+                xkb_state_new(keymap.get()), xkb_state_unref);
+            for (uint32_t mods = 0; mods < (1u << mod_bits); ++mods) {
+                uint32_t depressed = 0;
+                uint32_t locked = 0;
+                for (int i = 0; i < mod_bits; ++i) {
+                    if (mods & (1u << i)) {
+                        (i == 1 ? locked : depressed) |= this->masks[i];
+                    }
+                }
+                xkb_state_update_mask(state.get(), depressed, 0, locked, 0, 0, 0);
+                for (uint32_t k = 0; k < count; ++k) {
+                    this->syms[(k << mod_bits) | mods] =
+                        xkb_state_key_get_one_sym(state.get(), this->min + k);
+                }
+            }
+            for (uint32_t k = 0; k < count; ++k) {
+                this->repeating[k] = xkb_keymap_key_repeats(keymap.get(), this->min + k);
+            }
+        }
+
+        // The modifier state the table is indexed by, one bit per modifier
+        // in the order above, from wl_keyboard.modifiers masks.
+        uint32_t modifiers(uint32_t depressed, uint32_t latched, uint32_t locked) const noexcept {
+            auto active = depressed | latched | locked;
+            uint32_t mods = 0;
+            for (int i = 0; i < mod_bits; ++i) {
+                if (active & this->masks[i]) {
+                    mods |= 1u << i;
+                }
+            }
+            return mods;
+        }
+        // The keysym of evdev code `key' under `mods'.
+        xkb_keysym_t lookup(uint32_t key, uint32_t mods) const noexcept {
+            auto k = key + 8 - this->min;
+            return k < this->repeating.size() ? this->syms[(k << mod_bits) | mods] : XKB_KEY_NoSymbol;
+        }
+        bool repeats(uint32_t key) const noexcept {
+            auto k = key + 8 - this->min;
+            return k < this->repeating.size() && this->repeating[k];
+        }
+
+    private:
+        uint32_t min = 0;
+        uint32_t masks[mod_bits] = { };
+        std::vector<xkb_keysym_t> syms;
+        std::vector<bool> repeating;
+    };
+
+    // Key repeat as wl_keyboard.repeat_info describes it, on a timerfd that
+    // is armed when a repeating key goes down and disarmed when it comes up
+    // or another key takes over.  fd() turns readable at each repeat; read
+    // it for the number of repeats due.
+    class key_repeat {
+    public:
+        key_repeat() : timer{timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)} { }
+
+        void configure(int32_t rate, int32_t delay) noexcept {
+            this->rate = rate;
+            this->delay = delay;
+            if (rate <= 0) {
+                this->release(this->held);
+            }
+        }
+        void press(uint32_t key) noexcept {
+            if (this->rate <= 0) {
+                return;
+            }
+            this->held = key;
+            auto ns = [](int64_t n) { return timespec{ n / 1'000'000'000, n % 1'000'000'000 }; };
+            itimerspec spec{ ns(1'000'000'000 / this->rate),
+                             ns(std::max(this->delay, 1) * int64_t{1'000'000}) };
+            timerfd_settime(this->timer.get(), 0, &spec, nullptr);
+        }
+        void release(uint32_t key) noexcept {
+            if (key != this->held) {
+                return;
+            }
+            this->held = 0;
+            itimerspec spec{ };
+            timerfd_settime(this->timer.get(), 0, &spec, nullptr);
+        }
+
+        int fd() const noexcept { return this->timer.get(); }
+        // The key repeating, 0 if none.
+        uint32_t key() const noexcept { return this->held; }
+
+    private:
+        safe_fd timer;
+        int32_t rate = 25;
+        int32_t delay = 600;
+        uint32_t held = 0;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_KEYBOARD_HH_*/
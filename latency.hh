@@ -0,0 +1,118 @@
+#ifndef INCLUDE_LATENCY_HH_
+#define INCLUDE_LATENCY_HH_
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <iostream>
+
+#include <time.h>
+
+#include "input.hh"
+
+namespace
+{
+    // Log-linear histogram of nanosecond durations after HdrHistogram: every
+    // power of two is split into `sub' linear buckets, so any value from
+    // 1 ns to centuries is kept within 1/sub of its true size in a fixed
+    // array, and recording is an increment.
+    class histogram {
+    public:
+        static constexpr int sub_bits = 6;
+        static constexpr uint64_t sub = uint64_t{1} << sub_bits;
+
+        void record(uint64_t ns) noexcept {
+            ++this->counts[index(ns)];
+            ++this->total;
+            this->peak = std::max(this->peak, ns);
+        }
+        uint64_t count() const noexcept { return this->total; }
+        uint64_t max() const noexcept { return this->peak; }
+        // The value below which a fraction `q' of the samples lie, to within
+        // the bucket width.
+        uint64_t percentile(double q) const noexcept {
+            auto rank = static_cast<uint64_t>(q * this->total + 0.5);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < buckets; ++i) {
+                seen += this->counts[i];
+                if (seen && seen >= rank) {
+                    return std::min(middle(i), this->peak);
+                }
+            }
+            return this->peak;
+        }
+
+    private:
+        static constexpr size_t buckets = (64 - sub_bits + 1) * sub;
+
+        static size_t index(uint64_t v) noexcept {
+            if (v < sub) {
+                return v;
+            }
+            auto shift = std::bit_width(v) - sub_bits - 1;
+            return (shift + 1) * sub + ((v >> shift) - sub);
+        }
+        static uint64_t middle(size_t i) noexcept {
+            if (i < sub) {
+                return i;
+            }
+            auto shift = i / sub - 1;
+            return ((sub + i % sub) << shift) + ((uint64_t{1} << shift) >> 1);
+        }
+
+        std::array<uint64_t, buckets> counts = { };
+        uint64_t total = 0;
+        uint64_t peak = 0;
+    };
+    template <class Ch>
+    auto& operator<<(std::basic_ostream<Ch>& output, histogram const& h) {
+        auto ms = [](uint64_t ns) { return ns * 1e-6; };
+        return output << "p50 " << ms(h.percentile(0.5)) << " ms, "
+                      << "p90 " << ms(h.percentile(0.9)) << " ms, "
+                      << "p99 " << ms(h.percentile(0.99)) << " ms, "
+                      << "p99.9 " << ms(h.percentile(0.999)) << " ms, "
+                      << "max " << ms(h.max()) << " ms over " << h.count();
+    }
+
+    // What wp_presentation feedback tells about the frames we committed.
+    struct latency_stats {
+        histogram input_to_commit;
+        histogram commit_to_present;
+        uint64_t presented = 0;
+        uint64_t discarded = 0;
+        uint64_t missed_vblanks = 0;
+    };
+    template <class Ch>
+    auto& operator<<(std::basic_ostream<Ch>& output, latency_stats const& s) {
+        return output << "input->commit: " << s.input_to_commit << '\n'
+                      << "commit->present: " << s.commit_to_present << '\n'
+                      << "presented " << s.presented << ", discarded " << s.discarded
+                      << ", missed vblanks " << s.missed_vblanks;
+    }
+
+    inline uint64_t clock_ns(clockid_t clock) noexcept {
+        timespec ts;
+        clock_gettime(clock, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+    }
+
+    // When `ev' happened on CLOCK_MONOTONIC.  Compositors stamp events with
+    // the 32-bit millisecond part of that clock; the missing high bits are
+    // taken from `now'.  Records without a stamp, or with one that cannot be
+    // on that clock, fall back to when we received them.
+    inline uint64_t event_ns(input_event const& ev, uint64_t now) noexcept {
+        if (!ev.time) {
+            return ev.stamp;
+        }
+        auto now_ms = now / 1'000'000;
+        auto ms = (now_ms & ~uint64_t{0xffffffff}) | ev.time;
+        if (ms > now_ms) {
+            ms -= uint64_t{1} << 32;
+        }
+        auto ns = ms * 1'000'000;
+        return ns <= ev.stamp && ev.stamp - ns < 10'000'000'000 ? ns : ev.stamp;
+    }
+} // ::(anonymous)
+
+#endif/*INCLUDE_LATENCY_HH_*/
@@ -4,6 +4,24 @@
 #include <stdexcept>
 #include <memory>
 #include <coroutine>
+#include <cerrno>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <optional>
+#include <mutex>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include <csignal>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
 
 #include <CL/sycl.hpp>
 
@@ -11,63 +29,31 @@
 #include <wayland-egl.h>
 #include "xdg-shell-v6-client.h"
 #include "zwp-tablet-v2-client.h"
+#include "presentation-time-client.h"
+#include "viewporter-client.h"
+#include "safe.hh"
+#include "slab.hh"
+#include "task.hh"
+#include "executor.hh"
+#include "dispatch.hh"
+#include "input.hh"
+#include "recorder.hh"
+#include "sycl-field.hh"
+#include "egl.hh"
+#include "shm.hh"
+#include "damage.hh"
+#include "stroke.hh"
+#include "renderer.hh"
+#include "latency.hh"
+#include "startup.hh"
+#include "keyboard.hh"
+#include "governor.hh"
+#include "trace.hh"
 
 #include <EGL/egl.h>
 #include <CL/cl_gl.h>
 #include <GLES3/gl3.h>
 
-template <class T>
-class task {
-public:
-    struct promise_type {
-        std::coroutine_handle<> continuation;
-        T result;
-        void unhandled_exception() { throw; }
-        auto get_return_object() noexcept { return task{*this}; }
-        auto initial_suspend() noexcept { return std::suspend_always{}; }
-        auto final_suspend() noexcept {
-            struct awaiter {
-                bool await_ready() noexcept { return false; }
-                void await_resume() noexcept { }
-                auto await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
-                    std::coroutine_handle<> continuation = handle.promise().continuation;
-                    if (!continuation) {
-                        continuation = std::noop_coroutine();
-                    }
-                    return continuation;
-                }
-            };
-            return awaiter{};
-        }
-        void return_value(T value) noexcept { this->result = std::move(value); }
-    };
-    ~task() noexcept { if (this->handle) this->handle.destroy(); }
-    task() : handle{nullptr} { }
-    task(task&& rhs) noexcept : handle{std::exchange(rhs.handle, nullptr)} { }
-    auto operator co_await() noexcept {
-        struct awaiter {
-            std::coroutine_handle<promise_type> handle;
-            bool await_ready() noexcept { return false; }
-            T await_resume() noexcept { return std::move(this->handle.promise().result); }
-            auto await_suspend(std::coroutine_handle<> handle) noexcept {
-                this->handle.promise().continuation = handle;
-                return this->handle;
-            }
-        };
-        return awaiter{this->handle};
-    }
-    T operator()() {
-        this->handle.resume();
-        return std::move(this->handle.promise().result);
-    }
-private:
-    explicit task(promise_type& p)
-        : handle{std::coroutine_handle<promise_type>::from_promise(p)}
-        {
-        }
-    std::coroutine_handle<promise_type> handle;
-};
-
 namespace
 {
     template <size_t...> struct seq { };
@@ -86,73 +72,105 @@ namespace
         return output;
     }
 
-    struct fatal_error : std::runtime_error {
-        fatal_error(char const* msg, std::source_location location)
-            : std::runtime_error(msg), location(location)
+    inline auto safe_ptr(wl_display* ptr, location loc = location::current()) {
+        return safe_ptr(ptr, wl_display_disconnect, loc);
+    }
+
+    // Every listened proxy owns one block holding its callbacks, reachable
+    // through its user data.  Blocks come from a slab per callback type and
+    // go back to it when the proxy is destroyed.
+    struct listener_block {
+        void (*release)(listener_block*) noexcept;
+    };
+    template <class Callback>
+    struct listener_node : listener_block {
+        explicit listener_node(Callback&& callback)
+            : listener_block{release}, callback{std::move(callback)}
             {
             }
-        std::source_location location;
+        static auto& pool() {
+            static slab<listener_node> instance;
+            return instance;
+        }
+        static void release(listener_block* block) noexcept {
+            pool().destroy(static_cast<listener_node*>(block));
+        }
+        Callback callback;
     };
-    template <class Ch>
-    auto& operator<<(std::basic_ostream<Ch>& output, std::source_location const& loc) {
-        return output << loc.file_name() << ':'
-                      << loc.line() << ':'
-                      << loc.column() << ':'
-                      << loc.function_name() << ':';
-    }
-    template <class Ch>
-    auto& operator<<(std::basic_ostream<Ch>& output, fatal_error const& x) {
-        return output << x.location << x.what();
-    }
-
-    using location = std::source_location;
-    template <class T>
-    auto safe_ptr(T* ptr, auto del, location loc = location::current()) {
-        if (!ptr) {
-            throw fatal_error("bad pointer", loc);
+    inline void release_listener(void* proxy) noexcept {
+        auto p = static_cast<wl_proxy*>(proxy);
+        if (auto block = static_cast<listener_block*>(wl_proxy_get_user_data(p))) {
+            wl_proxy_set_user_data(p, nullptr);
+            block->release(block);
         }
-        return std::unique_ptr<T, decltype (del)>(ptr, del);
-    }
-    inline auto safe_ptr(wl_display* ptr, location loc = location::current()) {
-        return safe_ptr(ptr, wl_display_disconnect, loc);
     }
 
 #define INTERN_SAFE_PTR(wl_client)                                      \
     inline auto safe_ptr(wl_client* ptr, location loc = location::current()) { \
         return safe_ptr(ptr, wl_client##_destroy, loc);                 \
     }
-    INTERN_SAFE_PTR(wl_registry)
     INTERN_SAFE_PTR(wl_compositor)
     INTERN_SAFE_PTR(wl_seat)
     INTERN_SAFE_PTR(wl_surface)
-    INTERN_SAFE_PTR(zxdg_shell_v6)
-    INTERN_SAFE_PTR(zxdg_surface_v6)
-    INTERN_SAFE_PTR(zxdg_toplevel_v6)
     INTERN_SAFE_PTR(zwp_tablet_manager_v2)
-    INTERN_SAFE_PTR(zwp_tablet_seat_v2)
-    INTERN_SAFE_PTR(zwp_tablet_tool_v2)
-    INTERN_SAFE_PTR(wl_egl_window)
-    INTERN_SAFE_PTR(wl_keyboard)
-    INTERN_SAFE_PTR(wl_pointer)
-    INTERN_SAFE_PTR(wl_touch)
+    INTERN_SAFE_PTR(wl_shm)
+    INTERN_SAFE_PTR(wl_event_queue)
+    INTERN_SAFE_PTR(wp_viewporter)
+    INTERN_SAFE_PTR(wp_viewport)
 #undef INTERN_SAFE_PTR
+    // Proxies that get listeners hand their block back on destruction.
+#define INTERN_SAFE_LISTENED_PTR(wl_client)                             \
+    inline void destroy(struct wl_client* ptr) noexcept {               \
+        release_listener(ptr);                                          \
+        wl_client##_destroy(ptr);                                       \
+    }                                                                   \
+    inline auto safe_ptr(struct wl_client* ptr, location loc = location::current()) { \
+        return safe_ptr(ptr, static_cast<void (*)(struct wl_client*) noexcept>(destroy), loc); \
+    }
+    INTERN_SAFE_LISTENED_PTR(wl_registry)
+    INTERN_SAFE_LISTENED_PTR(wl_callback)
+    INTERN_SAFE_LISTENED_PTR(zxdg_shell_v6)
+    INTERN_SAFE_LISTENED_PTR(zxdg_surface_v6)
+    INTERN_SAFE_LISTENED_PTR(zxdg_toplevel_v6)
+    INTERN_SAFE_LISTENED_PTR(zwp_tablet_seat_v2)
+    INTERN_SAFE_LISTENED_PTR(zwp_tablet_tool_v2)
+    INTERN_SAFE_LISTENED_PTR(wl_keyboard)
+    INTERN_SAFE_LISTENED_PTR(wl_pointer)
+    INTERN_SAFE_LISTENED_PTR(wl_touch)
+    INTERN_SAFE_LISTENED_PTR(wp_presentation)
+    INTERN_SAFE_LISTENED_PTR(wp_presentation_feedback)
+#undef INTERN_SAFE_LISTENED_PTR
 
-    template <class Callback, size_t I>
+    // A proxy wrapper that creates its children on `queue'.
+    template <class T>
+    auto safe_wrapper(T* proxy, wl_event_queue* queue, location loc = location::current()) {
+        auto wrapper = safe_ptr(static_cast<T*>(wl_proxy_create_wrapper(proxy)),
+                                wl_proxy_wrapper_destroy, loc);
+        wl_proxy_set_queue(reinterpret_cast<wl_proxy*>(wrapper.get()), queue);
+        return wrapper;
+    }
+
+    // Listeners run as trace events named after their interface.
+    template <class Callback, size_t I, char const* Interface>
     void func(void* data, auto, auto... args) {
-        std::get<I>(*reinterpret_cast<Callback*>(data))(args...);
+        trace_scope scope(Interface);
+        auto node = static_cast<listener_node<Callback>*>(static_cast<listener_block*>(data));
+        std::get<I>(node->callback)(args...);
     }
 
 #define INTERN_ADD_LISTENER(wl_client)                                  \
+    constexpr char wl_client##_name[] = #wl_client;                     \
     template <class Callback, size_t... I>                              \
-    auto add_listener_impl(wl_client* ptr, Callback&& callback, seq<I...>) { \
-        static Callback backup = std::move(callback);                   \
-        static wl_client##_listener listener { func<Callback, I>... };  \
-        wl_client##_add_listener(ptr, &listener, &backup);              \
+    auto add_listener_impl(struct wl_client* ptr, Callback&& callback, seq<I...>) { \
+        static wl_client##_listener const listener { func<Callback, I, wl_client##_name>... }; \
+        listener_block* block = listener_node<Callback>::pool().make(std::move(callback)); \
+        wl_client##_add_listener(ptr, &listener, block);                \
     }                                                                   \
-    inline auto add_listener(wl_client* ptr, auto&&... callback) {      \
+    inline auto add_listener(struct wl_client* ptr, auto&&... callback) {      \
         add_listener_impl(ptr, std::tuple{callback...}, gen_seq<sizeof ...(callback)>()); \
     }
     INTERN_ADD_LISTENER(wl_registry)
+    INTERN_ADD_LISTENER(wl_callback)
     INTERN_ADD_LISTENER(zxdg_shell_v6)
     INTERN_ADD_LISTENER(zxdg_surface_v6)
     INTERN_ADD_LISTENER(zxdg_toplevel_v6)
@@ -161,9 +179,226 @@ namespace
     INTERN_ADD_LISTENER(wl_keyboard)
     INTERN_ADD_LISTENER(wl_pointer)
     INTERN_ADD_LISTENER(wl_touch)
+    INTERN_ADD_LISTENER(wp_presentation)
+    INTERN_ADD_LISTENER(wp_presentation_feedback)
 #undef INTERN_ADD_LISTENER
+
+    struct options {
+        char const* record = nullptr;
+        char const* replay = nullptr;
+        char const* decode = nullptr;
+        bool max_speed = false;
+        std::string_view backend = "glsl";
+        std::string_view sycl_device = "default";
+        std::string_view present = "egl";
+        double target_fps = 0; // adaptive resolution when set
+        int windows = 1;
+        char const* trace = nullptr; // captured from the start when set
+    };
+    inline auto parse_options(int argc, char** argv, location loc = location::current()) {
+        options opts;
+        for (int i = 1; i < argc; ++i) {
+            std::string_view arg = argv[i];
+            auto value = [&]() {
+                if (++i == argc) {
+                    throw fatal_error("missing option value", loc);
+                }
+                return argv[i];
+            };
+            if (arg == "--record") {
+                opts.record = value();
+            }
+            else if (arg == "--replay") {
+                opts.replay = value();
+            }
+            else if (arg == "--max-speed") {
+                opts.max_speed = true;
+            }
+            else if (arg == "--decode") {
+                opts.decode = value();
+            }
+            else if (arg == "--backend") {
+                opts.backend = value();
+                if (opts.backend != "glsl" && opts.backend != "sycl") {
+                    throw fatal_error("backend is either glsl or sycl", loc);
+                }
+            }
+            else if (arg == "--sycl-device") {
+                opts.sycl_device = value();
+                if (opts.sycl_device != "default" && opts.sycl_device != "cpu" &&
+                    opts.sycl_device != "gpu")
+                {
+                    throw fatal_error("SYCL device is one of default, cpu or gpu", loc);
+                }
+            }
+            else if (arg == "--present") {
+                opts.present = value();
+                if (opts.present != "egl" && opts.present != "shm") {
+                    throw fatal_error("presentation is either egl or shm", loc);
+                }
+            }
+            else if (arg == "--windows") {
+                opts.windows = std::atoi(value());
+                if (opts.windows < 1 || opts.windows > 16) {
+                    throw fatal_error("window count is from 1 to 16", loc);
+                }
+            }
+            else if (arg == "--trace") {
+                opts.trace = value();
+            }
+            else if (arg == "--target-fps") {
+                opts.target_fps = std::strtod(value(), nullptr);
+                if (!(opts.target_fps > 0)) {
+                    throw fatal_error("target frame rate must be positive", loc);
+                }
+            }
+            else {
+                std::cerr << "usage: " << argv[0]
+                          << " [--record FILE | --replay FILE [--max-speed] | --decode FILE]"
+                          << " [--backend glsl|sycl [--sycl-device default|cpu|gpu]]"
+                          << " [--present egl|shm] [--target-fps N] [--windows N] [--trace FILE]"
+                          << std::endl;
+                throw fatal_error("unknown option", loc);
+            }
+        }
+        if (opts.present == "shm" && opts.backend != "glsl") {
+            throw fatal_error("wl_shm presentation uses the CPU renderer only", loc);
+        }
+        return opts;
+    }
+
+    // Running mean and worst case of a per-frame duration in milliseconds.
+    struct timing {
+        uint64_t count = 0;
+        double total = 0;
+        double peak = 0;
+        void add(double ms) noexcept {
+            ++this->count;
+            this->total += ms;
+            this->peak = std::max(this->peak, ms);
+        }
+    };
+    template <class Ch>
+    auto& operator<<(std::basic_ostream<Ch>& output, timing const& t) {
+        return output << "avg " << (t.count ? t.total / t.count : 0) << " ms, "
+                      << "max " << t.peak << " ms over " << t.count << " frames";
+    }
+
+    template <class T>
+    using proxy_ptr = decltype (safe_ptr(std::declval<T*>()));
+
+    // One toplevel of the session.  Its surface is on a queue of its own, so
+    // its frame callbacks, buffer releases and presentation feedback are
+    // dispatched by its render thread alone and a slow window never holds
+    // up another.  Its shell objects stay on the shell queue, whose thread
+    // hands configures over through `configure_ready'; the input threads
+    // route its events into its rings and raise `input_ready'.  Everything
+    // it draws with is made on the render thread.  The surface is committed
+    // for its first configure on construction.
+    struct window {
+        struct configure_state {
+            int width;
+            int height;
+            uint32_t serial;
+        };
+
+        window(int index, wl_display* display, wl_compositor* compositor, zxdg_shell_v6* shell,
+               startup_timeline& timeline)
+            : index{index},
+              queue{safe_ptr(wl_display_create_queue(display))},
+              surface{safe_ptr(wl_compositor_create_surface(compositor))},
+              xsurface{safe_ptr(zxdg_shell_v6_get_xdg_surface(shell, this->surface.get()))},
+              toplevel{safe_ptr(zxdg_surface_v6_get_toplevel(this->xsurface.get()))}
+            {
+                wl_proxy_set_queue(reinterpret_cast<wl_proxy*>(this->surface.get()), this->queue.get());
+                add_listener(this->xsurface.get(),
+                             [this, &timeline](uint32_t serial) noexcept {
+                                 if (this->handshake_start) {
+                                     timeline.mark("configure handshake", this->handshake_start,
+                                                   monotonic_ns());
+                                     this->handshake_start = 0;
+                                 }
+                                 this->pending.serial = serial;
+                                 {
+                                     std::lock_guard lock(this->configure_lock);
+                                     this->latest = this->pending;
+                                 }
+                                 eventfd_write(this->configure_ready.get(), 1);
+                             });
+                add_listener(this->toplevel.get(),
+                             [this](int width, int height, auto) noexcept {
+                                 this->pending.width = width;
+                                 this->pending.height = height;
+                             },
+                             []() noexcept { });
+                this->handshake_start = monotonic_ns();
+                wl_surface_commit(this->surface.get());
+            }
+        window(window const&) = delete;
+        window& operator=(window const&) = delete;
+
+        int index;
+        std::string name = "render " + std::to_string(index); // of its thread, in traces
+        proxy_ptr<wl_event_queue> queue;
+        proxy_ptr<wl_surface> surface;
+        proxy_ptr<zxdg_surface_v6> xsurface;
+        proxy_ptr<zxdg_toplevel_v6> toplevel;
+        std::mutex configure_lock;
+        configure_state pending = { };
+        configure_state latest = { };
+        safe_fd configure_ready{eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+        uint64_t handshake_start = 0;
+        std::unique_ptr<input_ring> inputs = std::make_unique<input_ring>();
+        std::unique_ptr<input_ring> tool_inputs = std::make_unique<input_ring>();
+        bool published = false;      // on the input thread
+        bool tool_published = false; // on the tablet thread
+        safe_fd input_ready{eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+        safe_fd report_request{eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+        safe_fd done{eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)};
+    };
+
+    // The window each touch point or tool is over, by id, for as long as
+    // the point is down or the tool exists.
+    class focus_map {
+    public:
+        focus_map() { this->entries.reserve(16); }
+        window*& operator[](int32_t id) {
+            for (auto& [key, w] : this->entries) {
+                if (key == id) {
+                    return w;
+                }
+            }
+            return this->entries.emplace_back(id, nullptr).second;
+        }
+        void erase(int32_t id) noexcept {
+            for (auto& entry : this->entries) {
+                if (entry.first == id) {
+                    entry = this->entries.back();
+                    this->entries.pop_back();
+                    return;
+                }
+            }
+        }
+        void clear() noexcept { this->entries.clear(); }
+    private:
+        std::vector<std::pair<int32_t, window*>> entries;
+    };
+
+    // Calls to the global operator new, counted for the exit report so a
+    // benchmark run shows whether the steady state allocates.
+    std::atomic<uint64_t> allocations = 0;
 } // :: (anonymous)
 
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (auto ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
 // int main() {
 //     if (auto display = wl_display_connect(nullptr)) {
 //         if (auto registry = wl_display_get_registry(display)) {
@@ -190,354 +425,1114 @@ namespace
 //     }
 // }
 
-int main() {
+int main(int argc, char** argv) {
     try {
-        auto display = safe_ptr(wl_display_connect(nullptr));
-        auto registry = safe_ptr(wl_display_get_registry(display.get()));
-
-        void* compositor_raw = nullptr;
-        void* shell_raw = nullptr;
-        void* seat_raw = nullptr;
-        void* tablet_raw = nullptr;
-        add_listener(registry.get(),
-                     [&](uint32_t name, std::string_view interface, uint32_t version) {
-                         if (interface == wl_compositor_interface.name) {
-                             compositor_raw = wl_registry_bind(registry.get(),
-                                                               name,
-                                                               &wl_compositor_interface,
-                                                               version);
-                         }
-                         else if (interface == zxdg_shell_v6_interface.name) {
-                             shell_raw = wl_registry_bind(registry.get(),
-                                                          name,
-                                                          &zxdg_shell_v6_interface,
-                                                          version);
-                         }
-                         else if (interface == wl_seat_interface.name) {
-                             seat_raw = wl_registry_bind(registry.get(),
-                                                         name,
-                                                         &wl_seat_interface,
-                                                         version);
-                         }
-                         else if (interface == zwp_tablet_manager_v2_interface.name) {
-                             tablet_raw = wl_registry_bind(registry.get(),
-                                                               name,
-                                                               &zwp_tablet_manager_v2_interface,
-                                                               version);
-                         }
-                     },
-                     [](auto...) noexcept { });
-        wl_display_roundtrip(display.get());
-
-        auto compositor = safe_ptr(reinterpret_cast<wl_compositor*>(compositor_raw));
-        auto shell = safe_ptr(reinterpret_cast<zxdg_shell_v6*>(shell_raw));
-        auto seat = safe_ptr(reinterpret_cast<wl_seat*>(seat_raw));
-        auto tablet = safe_ptr(reinterpret_cast<zwp_tablet_manager_v2*>(tablet_raw));
-
-        add_listener(shell.get(),
-                     [&](uint32_t serial) noexcept {
-                         zxdg_shell_v6_pong(shell.get(), serial);
-                     });
-
-        auto surface = safe_ptr(wl_compositor_create_surface(compositor.get()));
-        auto xsurface = safe_ptr(zxdg_shell_v6_get_xdg_surface(shell.get(), surface.get()));
-        add_listener(xsurface.get(),
-                     [&](uint32_t serial) noexcept {
-                         zxdg_surface_v6_ack_configure(xsurface.get(), serial);
-                     });
-
-        auto egl_display = safe_ptr(eglGetDisplay(display.get()), eglTerminate);
-        eglInitialize(egl_display.get(), nullptr, nullptr);
-        eglBindAPI(EGL_OPENGL_ES_API);
-
-        float resolution_vec[2] = { 640, 480 };
-        auto egl_window = safe_ptr(wl_egl_window_create(surface.get(),
-                                                        resolution_vec[0],
-                                                        resolution_vec[1]));
-
-        auto toplevel = safe_ptr(zxdg_surface_v6_get_toplevel(xsurface.get()));
-        add_listener(toplevel.get(),
-                     [&](int width, int height, auto) noexcept {
-                         if (width * height) {
-                             wl_egl_window_resize(egl_window.get(), width, height, 0, 0);
-                             glViewport(0, 0, width, height);
-                             resolution_vec[0] = width;
-                             resolution_vec[1] = height;
-                         }
-                     },
-                     [&]() noexcept { });
-        wl_surface_commit(surface.get());
-
-        EGLConfig config;
-        EGLint num_config;
-        eglChooseConfig(egl_display.get(),
-                        std::array<EGLint, 15>(
-                            {
-                                EGL_LEVEL, 0,
-                                EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-                                EGL_RED_SIZE, 8,
-                                EGL_GREEN_SIZE, 8,
-                                EGL_BLUE_SIZE, 8,
-                                EGL_ALPHA_SIZE, 8,
-                                EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
-                                EGL_NONE,
-                            }
-                        ).data(),
-                        &config, 1, &num_config);
-        auto egl_context = safe_ptr(eglCreateContext(egl_display.get(),
-                                                     config,
-                                                     EGL_NO_CONTEXT,
-                                                     std::array<EGLint, 3>(
-                                                         {
-                                                             EGL_CONTEXT_CLIENT_VERSION, 2,
-                                                             EGL_NONE,
-                                                         }
-                                                     ).data()),
-                                    [&egl_display](auto ptr) noexcept {
-                                        eglDestroyContext(egl_display.get(), ptr);
-                                    });
-        auto egl_surface = safe_ptr(eglCreateWindowSurface(egl_display.get(),
-                                                           config,
-                                                           egl_window.get(),
-                                                           nullptr),
-                                    [&egl_display](auto ptr) noexcept {
-                                        eglDestroySurface(egl_display.get(), ptr);
-                                    });
-        eglMakeCurrent(egl_display.get(),
-                       egl_surface.get(), egl_surface.get(),
-                       egl_context.get());
-
-        // {
-        //     cl_platform_id platform_id = nullptr;
-        //     cl_uint ret_num_platforms;
-        //     clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
-        //     cl_device_id device_id = nullptr;
-        //     clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_GPU, 1, &device_id, nullptr);
-        //     cl_int ret = 0;
-        //     auto context = clCreateContext(std::array<cl_context_properties, 7> {
-        //             CL_CONTEXT_PLATFORM, (cl_context_properties) platform_id,
-        //             CL_GL_CONTEXT_KHR, (cl_context_properties) eglGetCurrentContext(),
-        //             CL_EGL_DISPLAY_KHR, (cl_context_properties) eglGetCurrentDisplay(),
-        //             0 }.data(),
-        //         1, &device_id, nullptr, nullptr, &ret);
-        //     std::cout << ret << std::endl;
-        //     std::cout << context << std::endl;
-        // }
-
-        auto keyboard = safe_ptr(wl_seat_get_keyboard(seat.get()));
-        uint32_t key = 0;
-        uint32_t state = 0;
-        add_listener(keyboard.get(),
-                     [](auto...) noexcept { }, // keymap
-                     [](auto...) noexcept { }, // enter
-                     [](auto...) noexcept { }, // leave
-                     [&](auto, auto, uint32_t k, uint32_t s) noexcept {
-                         key = k;
-                         state = s;
-                     },
-                     [](auto...) noexcept { }, // modifier
-                     [](auto...) noexcept { });// repeat_info
-
-        auto pointer = safe_ptr(wl_seat_get_pointer(seat.get()));
-        float pointer_vec[16][2] = { };
-        for (auto& item : pointer_vec) { item[0] = -256; item[1] = -256; }
-        add_listener(pointer.get(),
-                     [](auto...) noexcept { }, // enter
-                     [](auto...) noexcept { }, // leave
-                     [&](auto, wl_fixed_t x, wl_fixed_t y) noexcept {
-                         pointer_vec[0][0] = static_cast<float>(wl_fixed_to_int(x));
-                         pointer_vec[0][1] = resolution_vec[1]; 
-                         pointer_vec[0][1] -= static_cast<float>(wl_fixed_to_int(y));
-                     },
-                     [](auto...) noexcept { }, // button
-                     [](auto... args) noexcept {
-                         std::cout << "axis: " << std::tuple(args...) << std::endl;
-                     }, // axis
-                     [](auto...) noexcept { }, // frame
-                     [](auto... args) noexcept {
-                         std::cout << "axis_source: " << std::tuple(args...) << std::endl;
-                     }, // axis_source
-                     [](auto... args) noexcept {
-                         std::cout << "axis_stop: " << std::tuple(args...) << std::endl;
-                     }, // axis_stop
-                     [](auto... args) noexcept {
-                         std::cout << "axis_discrete: " << std::tuple(args...) << std::endl;
-                     });// axis_discrete
-
-        auto touch = safe_ptr(wl_seat_get_touch(seat.get()));
-        add_listener(touch.get(),
-                     [](auto...) noexcept { }, // down
-                     [](auto...) noexcept { }, // up
-                     [&](uint32_t, int32_t id, wl_fixed_t x, wl_fixed_t y) noexcept {
-                         int i = id % 10 + 1;
-                         pointer_vec[i][0] = static_cast<float>(wl_fixed_to_int(x));
-                         pointer_vec[i][1] = resolution_vec[1]; 
-                         pointer_vec[i][1] -= static_cast<float>(wl_fixed_to_int(y));
-                     },
-                     [](auto...) noexcept { }, // frame
-                     [](auto...) noexcept { }, // cancel
-                     [](auto...) noexcept { }, // shape
-                     [](auto...) noexcept { });// orientation
-
-        std::cout << "-------------------------------------------------------" << std::endl;
-        std::cout << zwp_tablet_manager_v2_get_version(tablet.get()) << std::endl;
-        auto slate = safe_ptr(zwp_tablet_manager_v2_get_tablet_seat(tablet.get(), seat.get()));
-        add_listener(slate.get(),
-                     [](auto...) noexcept {
-                         std::cout << "A tablet added." << std::endl;
-                     },
-                     [&](auto stylus) noexcept {
-                         std::cout << "A tool added." << std::endl;
-                         add_listener(
-                             stylus,
-                             [](auto tool_type) noexcept {
-                                 std::cout << "type: " << tool_type << std::endl;
-                             },
-                             [](auto hwsn_hi, auto hwsn_lo) noexcept {
-                                 std::cout << "sn: " << hwsn_hi << ':' << hwsn_lo << std::endl;
-                             },
-                             [](auto hwid_hi, auto hwid_lo) noexcept {
-                                 std::cout << "id: " << hwid_hi << ':' << hwid_lo << std::endl;
-                             },
-                             [](auto capability) noexcept {
-                                 std::cout << "caps: " << capability << std::endl;
-                             },
-                             []() noexcept {
-                                 std::cout << "done." << std::endl;
-                             },
-                             [stylus]() noexcept {
-                                 std::cout << "removed." << std::endl;
-                                 zwp_tablet_tool_v2_destroy(stylus);
-                             },
-                             [](auto serial, auto, auto) noexcept {
-                                 std::cout << "proximity in: " << serial << std::endl;
-                             },
-                             []() noexcept {
-                                 std::cout << "proximity out." << std::endl;
-                             },
-                             [](auto serial) noexcept {
-                                 std::cout << "down: " << serial << std::endl;
-                             },
-                             []() noexcept {
-                                 std::cout << "up." << std::endl;
-                             },
-                             [&](auto x, auto y) noexcept {
-                                 std::cout << "move: "
-                                           << std::complex(wl_fixed_to_double(x),
-                                                           wl_fixed_to_double(y)) << std::endl;
-                                 pointer_vec[15][0] = static_cast<float>(wl_fixed_to_int(x));
-                                 pointer_vec[15][1] = resolution_vec[1]; 
-                                 pointer_vec[15][1] -= static_cast<float>(wl_fixed_to_int(y));
-                             },
-                             [](auto pressure) noexcept {
-                                 std::cout << "pressure: " << pressure << std::endl;
-                             },
-                             [](auto distance) noexcept {
-                                 std::cout << "distance: " << distance << std::endl;
-                             },
-                             [](auto phi, auto theta) noexcept {
-                                 std::cout << "tilt: "
-                                           << std::complex(wl_fixed_to_double(phi),
-                                                           wl_fixed_to_double(theta)) << std::endl;
-                             },
-                             [](auto rotation) noexcept {
-                                 std::cout << "rotation: " << rotation << std::endl;
-                             },
-                             [](auto slider) noexcept {
-                                 std::cout << "slider: " << slider << std::endl;;
-                             },
-                             [](auto degree, auto clicks) noexcept {
-                                 std::cout << "wheel: " << degree << '/' << clicks << std::endl;
-                             },
-                             [](auto serial, auto button, auto state) noexcept {
-                                 std::cout << "button: " << serial << ' ' << button << ' '
-                                           << state << std::endl;
-                             },
-                             [](auto time) noexcept {
-                                 std::cout << "frame: " << time << std::endl;
+        auto const opts = parse_options(argc, argv);
+        if (opts.decode) {
+            input_recording recording(opts.decode);
+            for (uint64_t i = 0; i < recording.size(); ++i) {
+                std::cout << recording[i] << '\n';
+            }
+            return 0;
+        }
+
+        // A trace is captured from the start with --trace, and otherwise
+        // between two SIGUSR2s; it is written when the capture ends.
+        auto trace_path = opts.trace ? opts.trace : "trace.json";
+        tracer::instance().name_thread("session");
+        if (opts.trace) {
+            tracer::instance().start();
+        }
+        startup_timeline timeline;
+        auto display = timeline.phase("connect", []() { return safe_ptr(wl_display_connect(nullptr)); });
+        executor ex(display.get());
+        // The session is one coroutine on `ex': setup steps that wait on the
+        // compositor overlap with local work.  Each window then runs a
+        // coroutine of its own on an executor of its own, on its render
+        // thread, whose frame loop sleeps on events instead of polling.
+        auto session = [&]() -> task<void> {
+            // SIGUSR1 dumps the statistics so far, and SIGUSR2 starts or
+            // ends a trace capture.  They are blocked before any thread
+            // starts, so they can only arrive through the signalfd.
+            sigset_t signals;
+            sigemptyset(&signals);
+            sigaddset(&signals, SIGUSR1);
+            sigaddset(&signals, SIGUSR2);
+            pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+            auto report_signal = safe_fd(signalfd(-1, &signals, SFD_CLOEXEC | SFD_NONBLOCK));
+
+            // Setup that needs nothing from the compositor runs on worker
+            // threads from the start, overlapping the registry and configure
+            // handshakes below: the SYCL device, the EGL display, config and
+            // context, and the program cache directory.  Each is awaited only
+            // where its result is first needed.
+            background<std::optional<sycl::device>> field_setup([&]() -> std::optional<sycl::device> {
+                if (opts.backend != "sycl") {
+                    return std::nullopt;
+                }
+                return timeline.phase("sycl device", [&]() { return select_device(opts.sycl_device); });
+            });
+            background<std::optional<egl_context>> context_setup([&]() -> std::optional<egl_context> {
+                if (opts.present != "egl") {
+                    return std::nullopt;
+                }
+                return timeline.phase("egl display and context", [&]() {
+                    return egl_context(display.get());
+                });
+            });
+            background<std::optional<program_cache>> cache_setup([&]() -> std::optional<program_cache> {
+                if (opts.present != "egl") {
+                    return std::nullopt;
+                }
+                return timeline.phase("program cache directory", []() { return program_cache(); });
+            });
+
+            auto registry_start = monotonic_ns();
+            auto registry = safe_ptr(wl_display_get_registry(display.get()));
+
+            void* compositor_raw = nullptr;
+            void* shell_raw = nullptr;
+            void* seat_raw = nullptr;
+            void* tablet_raw = nullptr;
+            void* shm_raw = nullptr;
+            void* presentation_raw = nullptr;
+            void* viewporter_raw = nullptr;
+            add_listener(registry.get(),
+                         [&](uint32_t name, std::string_view interface, uint32_t version) {
+                             if (interface == wl_compositor_interface.name) {
+                                 compositor_raw = wl_registry_bind(registry.get(),
+                                                                   name,
+                                                                   &wl_compositor_interface,
+                                                                   version);
+                             }
+                             else if (interface == zxdg_shell_v6_interface.name) {
+                                 shell_raw = wl_registry_bind(registry.get(),
+                                                              name,
+                                                              &zxdg_shell_v6_interface,
+                                                              version);
+                             }
+                             else if (interface == wl_seat_interface.name) {
+                                 seat_raw = wl_registry_bind(registry.get(),
+                                                             name,
+                                                             &wl_seat_interface,
+                                                             version);
+                             }
+                             else if (interface == zwp_tablet_manager_v2_interface.name) {
+                                 tablet_raw = wl_registry_bind(registry.get(),
+                                                                   name,
+                                                                   &zwp_tablet_manager_v2_interface,
+                                                                   version);
+                             }
+                             else if (interface == wl_shm_interface.name) {
+                                 shm_raw = wl_registry_bind(registry.get(),
+                                                            name,
+                                                            &wl_shm_interface,
+                                                            version);
+                             }
+                             else if (interface == wp_presentation_interface.name) {
+                                 presentation_raw = wl_registry_bind(registry.get(),
+                                                                     name,
+                                                                     &wp_presentation_interface,
+                                                                     version);
                              }
-                         );
-                     },
-                     [](auto...) noexcept {
-                         std::cout << "A pad added." << std::endl;
-                     });
-
-        auto program = glCreateProgram();
-        auto compile = [](auto program, auto shader_type, char const* code) noexcept {
-            GLint compiled = 0;
-            if (auto id = glCreateShader(shader_type)) {
-                glShaderSource(id, 1, &code, nullptr);
-                glCompileShader(id);
-                glGetShaderiv(id, GL_COMPILE_STATUS, &compiled);
-                if (compiled) {
-                    glAttachShader(program, id);
+                             else if (interface == wp_viewporter_interface.name) {
+                                 viewporter_raw = wl_registry_bind(registry.get(),
+                                                                   name,
+                                                                   &wp_viewporter_interface,
+                                                                   1);
+                             }
+                         },
+                         [](auto...) noexcept { });
+            co_await ex.roundtrip();
+            timeline.mark("registry", registry_start, monotonic_ns());
+
+            // Shell, core input and tablet events each have a queue and a
+            // thread of their own, so that a flood of tool motion can neither
+            // delay a ping nor a configure.  What a window's renderer waits
+            // on, frame callbacks and buffer releases, is on that window's
+            // queue.
+            auto shell_queue = safe_ptr(wl_display_create_queue(display.get()));
+            auto input_queue = safe_ptr(wl_display_create_queue(display.get()));
+            auto tablet_queue = safe_ptr(wl_display_create_queue(display.get()));
+
+            auto compositor = safe_ptr(reinterpret_cast<wl_compositor*>(compositor_raw));
+            auto shell = safe_ptr(reinterpret_cast<zxdg_shell_v6*>(shell_raw));
+            wl_proxy_set_queue(reinterpret_cast<wl_proxy*>(shell.get()), shell_queue.get());
+            auto seat = safe_ptr(reinterpret_cast<wl_seat*>(seat_raw));
+            auto tablet = safe_ptr(reinterpret_cast<zwp_tablet_manager_v2*>(tablet_raw));
+            auto shm = safe_ptr(reinterpret_cast<wl_shm*>(shm_raw));
+            // Presentation feedback is optional; without it only input to
+            // commit latency is measured.
+            std::unique_ptr<wp_presentation, void (*)(wp_presentation*) noexcept> presentation{
+                nullptr, destroy};
+            // Announced on the session thread, read by the render threads.
+            std::atomic<clockid_t> presentation_clock = CLOCK_MONOTONIC;
+            if (presentation_raw) {
+                presentation = safe_ptr(reinterpret_cast<wp_presentation*>(presentation_raw));
+                add_listener(presentation.get(),
+                             [&](uint32_t clock) noexcept {
+                                 presentation_clock.store(clock, std::memory_order_relaxed);
+                             });
+            }
+            // So is wp_viewporter, which only the adaptive resolution mode
+            // of the wl_shm presentation needs.
+            std::unique_ptr<wp_viewporter, void (*)(wp_viewporter*)> viewporter{
+                nullptr, wp_viewporter_destroy};
+            if (viewporter_raw) {
+                viewporter = safe_ptr(reinterpret_cast<wp_viewporter*>(viewporter_raw));
+            }
+
+            add_listener(shell.get(),
+                         [&](uint32_t serial) noexcept {
+                             zxdg_shell_v6_pong(shell.get(), serial);
+                         });
+
+            // The compositor answers each window with its first configure
+            // while EGL, the shaders and the input objects are set up below.
+            std::vector<std::unique_ptr<window>> windows;
+            for (int i = 0; i < opts.windows; ++i) {
+                windows.push_back(std::make_unique<window>(i, display.get(), compositor.get(),
+                                                           shell.get(), timeline));
+            }
+            queue_thread shell_thread(display.get(), shell_queue.get(), "shell");
+            wl_display_flush(display.get());
+
+            // {
+            //     cl_platform_id platform_id = nullptr;
+            //     cl_uint ret_num_platforms;
+            //     clGetPlatformIDs(1, &platform_id, &ret_num_platforms);
+            //     cl_device_id device_id = nullptr;
+            //     clGetDeviceIDs(platform_id, CL_DEVICE_TYPE_GPU, 1, &device_id, nullptr);
+            //     cl_int ret = 0;
+            //     auto context = clCreateContext(std::array<cl_context_properties, 7> {
+            //             CL_CONTEXT_PLATFORM, (cl_context_properties) platform_id,
+            //             CL_GL_CONTEXT_KHR, (cl_context_properties) eglGetCurrentContext(),
+            //             CL_EGL_DISPLAY_KHR, (cl_context_properties) eglGetCurrentDisplay(),
+            //             0 }.data(),
+            //         1, &device_id, nullptr, nullptr, &ret);
+            //     std::cout << ret << std::endl;
+            //     std::cout << context << std::endl;
+            // }
+
+            auto input_start = monotonic_ns();
+            // Input proxies are created through wrappers bound to the input
+            // and tablet queues.  Listeners only publish records to the rings
+            // of the window the event is for; each window drains its own
+            // once per frame.  Keyboard and pointer events go to the window
+            // the seat last entered, a touch point's to the window it went
+            // down on, and a tool's to the window it came into proximity of.
+            // Focus is only kept on the thread of the queue its events
+            // arrive on.
+            auto seat_input = safe_wrapper(seat.get(), input_queue.get());
+            auto tablet_input = safe_wrapper(tablet.get(), tablet_queue.get());
+            // While a recording is replayed, its thread is the only producer
+            // of the windows' rings and live input is ignored.  Each record
+            // goes back to the window it was recorded for, so a recording
+            // needs as many windows as it was made with.
+            auto recorder = opts.record ? std::make_unique<input_recorder>(opts.record) : nullptr;
+            auto replay = opts.replay ? std::make_unique<input_recording>(opts.replay) : nullptr;
+            if (replay && replay->windows() > windows.size()) {
+                throw fatal_error("the recording needs more --windows", location::current());
+            }
+            auto window_of = [&](wl_surface* surface) noexcept -> window* {
+                for (auto& w : windows) {
+                    if (w->surface.get() == surface) {
+                        return w.get();
+                    }
+                }
+                return nullptr;
+            };
+            auto publisher = [&](bool tool) {
+                return [&, tool](window* w, input_kind kind, uint32_t time, int32_t id,
+                                 uint32_t value, float x, float y) noexcept {
+                    if (replay || !w) {
+                        return;
+                    }
+                    input_event ev {
+                        monotonic_ns(), time, kind, static_cast<uint16_t>(w->index), id, value, x, y,
+                    };
+                    if (recorder) {
+                        recorder->write(ev);
+                    }
+                    (tool ? w->tool_inputs : w->inputs)->push(ev);
+                    (tool ? w->tool_published : w->published) = true;
+                };
+            };
+            auto publish = publisher(false);
+            auto publish_tool = publisher(true);
+            window* key_focus = nullptr;
+            window* pointer_focus = nullptr;
+            focus_map touch_focus;
+            focus_map tool_focus;
+            // Tools the tablet seat removed, destroyed by the tablet thread
+            // once the dispatch that reported them returned, since their
+            // own listener cannot free the block it runs from.
+            std::vector<zwp_tablet_tool_v2*> removed_tools;
+
+            // The keymap is compiled on the input thread, which translates
+            // modifier masks with it; each window picks up a new table for
+            // its keysym lookups at its next key.
+            std::mutex keymap_lock;
+            std::shared_ptr<keysym_table const> keymap;
+            std::atomic<uint64_t> keymap_serial = 0;
+            std::shared_ptr<keysym_table const> input_keymap;
+            auto keyboard = safe_ptr(wl_seat_get_keyboard(seat_input.get()));
+            add_listener(keyboard.get(),
+                         [&](uint32_t format, int32_t fd, uint32_t size) noexcept {
+                             if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
+                                 ::close(fd);
+                                 return;
+                             }
+                             try {
+                                 input_keymap = std::make_shared<keysym_table const>(fd, size);
+                                 std::lock_guard lock(keymap_lock);
+                                 keymap = input_keymap;
+                                 ++keymap_serial;
+                             }
+                             catch (fatal_error& ex) {
+                                 std::cerr << ex << std::endl;
+                             }
+                         },
+                         [&](auto, wl_surface* surface, auto) noexcept {
+                             key_focus = window_of(surface);
+                         },
+                         [&](auto...) noexcept {
+                             publish(key_focus, input_kind::keyboard_leave, 0, 0, 0, 0, 0);
+                             key_focus = nullptr;
+                         },
+                         [&](auto, uint32_t time, uint32_t k, uint32_t s) noexcept {
+                             publish(key_focus, input_kind::key, time, k, s, 0, 0);
+                         },
+                         [&](auto, uint32_t depressed, uint32_t latched, uint32_t locked, auto) noexcept {
+                             if (input_keymap) {
+                                 publish(key_focus, input_kind::key_modifiers, 0, 0,
+                                         input_keymap->modifiers(depressed, latched, locked), 0, 0);
+                             }
+                         },
+                         [&](int32_t rate, int32_t delay) noexcept {
+                             for (auto& w : windows) {
+                                 publish(w.get(), input_kind::key_repeat_info, 0, delay, rate, 0, 0);
+                             }
+                         });
+
+            auto pointer = safe_ptr(wl_seat_get_pointer(seat_input.get()));
+            add_listener(pointer.get(),
+                         [&](auto, wl_surface* surface, auto, auto) noexcept {
+                             pointer_focus = window_of(surface);
+                         },
+                         [&](auto...) noexcept {
+                             pointer_focus = nullptr;
+                         },
+                         [&](uint32_t time, wl_fixed_t x, wl_fixed_t y) noexcept {
+                             publish(pointer_focus, input_kind::pointer_motion, time, 0, 0,
+                                     wl_fixed_to_double(x), wl_fixed_to_double(y));
+                         },
+                         [&](auto, uint32_t time, uint32_t button, uint32_t s) noexcept {
+                             publish(pointer_focus, input_kind::pointer_button, time, button, s, 0, 0);
+                         },
+                         [&](uint32_t time, uint32_t axis, wl_fixed_t value) noexcept {
+                             publish(pointer_focus, input_kind::pointer_axis, time, 0, axis,
+                                     wl_fixed_to_double(value), 0);
+                         },
+                         [&]() noexcept {
+                             publish(pointer_focus, input_kind::pointer_frame, 0, 0, 0, 0, 0);
+                         },
+                         [&](uint32_t source) noexcept {
+                             publish(pointer_focus, input_kind::pointer_axis_source, 0, 0, source, 0, 0);
+                         },
+                         [&](uint32_t time, uint32_t axis) noexcept {
+                             publish(pointer_focus, input_kind::pointer_axis_stop, time, 0, axis, 0, 0);
+                         },
+                         [&](uint32_t axis, int32_t discrete) noexcept {
+                             publish(pointer_focus, input_kind::pointer_axis_discrete, 0, discrete, axis, 0, 0);
+                         });
+
+            auto touch = safe_ptr(wl_seat_get_touch(seat_input.get()));
+            add_listener(touch.get(),
+                         [&](auto, uint32_t time, wl_surface* surface, int32_t id,
+                             wl_fixed_t x, wl_fixed_t y) noexcept {
+                             touch_focus[id] = window_of(surface);
+                             publish(touch_focus[id], input_kind::touch_down, time, id, 0,
+                                     wl_fixed_to_double(x), wl_fixed_to_double(y));
+                         },
+                         [&](auto, uint32_t time, int32_t id) noexcept {
+                             publish(touch_focus[id], input_kind::touch_up, time, id, 0, 0, 0);
+                             touch_focus.erase(id);
+                         },
+                         [&](uint32_t time, int32_t id, wl_fixed_t x, wl_fixed_t y) noexcept {
+                             publish(touch_focus[id], input_kind::touch_motion, time, id, 0,
+                                     wl_fixed_to_double(x), wl_fixed_to_double(y));
+                         },
+                         [&]() noexcept {
+                             for (auto& w : windows) {
+                                 publish(w.get(), input_kind::touch_frame, 0, 0, 0, 0, 0);
+                             }
+                         },
+                         [&]() noexcept {
+                             for (auto& w : windows) {
+                                 publish(w.get(), input_kind::touch_cancel, 0, 0, 0, 0, 0);
+                             }
+                             touch_focus.clear();
+                         },
+                         [](auto...) noexcept { }, // shape
+                         [](auto...) noexcept { });// orientation
+
+            std::cout << "-------------------------------------------------------" << std::endl;
+            std::cout << zwp_tablet_manager_v2_get_version(tablet.get()) << std::endl;
+            auto slate = safe_ptr(zwp_tablet_manager_v2_get_tablet_seat(tablet_input.get(), seat.get()));
+            add_listener(slate.get(),
+                         [](auto...) noexcept {
+                             std::cout << "A tablet added." << std::endl;
+                         },
+                         [&](auto stylus) noexcept {
+                             std::cout << "A tool added." << std::endl;
+                             auto id = static_cast<int32_t>(wl_proxy_get_id(reinterpret_cast<wl_proxy*>(stylus)));
+                             add_listener(
+                                 stylus,
+                                 [](auto tool_type) noexcept {
+                                     std::cout << "type: " << tool_type << std::endl;
+                                 },
+                                 [](auto hwsn_hi, auto hwsn_lo) noexcept {
+                                     std::cout << "sn: " << hwsn_hi << ':' << hwsn_lo << std::endl;
+                                 },
+                                 [](auto hwid_hi, auto hwid_lo) noexcept {
+                                     std::cout << "id: " << hwid_hi << ':' << hwid_lo << std::endl;
+                                 },
+                                 [](auto capability) noexcept {
+                                     std::cout << "caps: " << capability << std::endl;
+                                 },
+                                 []() noexcept {
+                                     std::cout << "done." << std::endl;
+                                 },
+                                 [&, stylus, id]() noexcept {
+                                     std::cout << "removed." << std::endl;
+                                     tool_focus.erase(id);
+                                     removed_tools.push_back(stylus);
+                                 },
+                                 [&, id](auto, auto, wl_surface* surface) noexcept {
+                                     tool_focus[id] = window_of(surface);
+                                     publish_tool(tool_focus[id], input_kind::tool_proximity_in,
+                                                  0, id, 0, 0, 0);
+                                 },
+                                 [&, id]() noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_proximity_out,
+                                                  0, id, 0, 0, 0);
+                                 },
+                                 [&, id](auto) noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_down, 0, id, 0, 0, 0);
+                                 },
+                                 [&, id]() noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_up, 0, id, 0, 0, 0);
+                                 },
+                                 [&, id](wl_fixed_t x, wl_fixed_t y) noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_motion, 0, id, 0,
+                                             wl_fixed_to_double(x), wl_fixed_to_double(y));
+                                 },
+                                 [&, id](uint32_t pressure) noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_pressure,
+                                                  0, id, pressure, 0, 0);
+                                 },
+                                 [&, id](uint32_t distance) noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_distance,
+                                                  0, id, distance, 0, 0);
+                                 },
+                                 [&, id](wl_fixed_t phi, wl_fixed_t theta) noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_tilt, 0, id, 0,
+                                             wl_fixed_to_double(phi), wl_fixed_to_double(theta));
+                                 },
+                                 [&, id](wl_fixed_t rotation) noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_rotation, 0, id, 0,
+                                             wl_fixed_to_double(rotation), 0);
+                                 },
+                                 [&, id](int32_t slider) noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_slider,
+                                                  0, id, 0, slider, 0);
+                                 },
+                                 [&, id](wl_fixed_t degrees, int32_t clicks) noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_wheel, 0, id, 0,
+                                             wl_fixed_to_double(degrees), clicks);
+                                 },
+                                 [&, id](auto, uint32_t button, uint32_t state) noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_button,
+                                                  0, id, button, state, 0);
+                                 },
+                                 [&, id](uint32_t time) noexcept {
+                                     publish_tool(tool_focus[id], input_kind::tool_frame,
+                                                  time, id, 0, 0, 0);
+                                 }
+                             );
+                         },
+                         [](auto...) noexcept {
+                             std::cout << "A pad added." << std::endl;
+                         });
+
+            timeline.mark("input objects", input_start, monotonic_ns());
+
+            // What the windows share of the renderer: the EGL display and a
+            // context every window's context shares objects with, the SYCL
+            // device, and the programs, linked once by the first window and
+            // used by all.  `shared_ready' is posted once per window when
+            // the first three are in, `programs_ready' once per other
+            // window when the programs are.
+            std::optional<egl_context> root;
+            std::optional<program_cache> cache;
+            std::optional<gl_programs> programs;
+            std::optional<sycl::device> device;
+            auto shared_ready = safe_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE));
+            auto programs_ready = safe_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK | EFD_SEMAPHORE));
+
+            // Any window leaving, on Escape or on an error, ends the session,
+            // as does the last window to draw the end of a replay; the
+            // others are woken to notice.
+            std::atomic<bool> quit = false;
+            auto leave = [&]() noexcept {
+                quit = true;
+                for (auto& w : windows) {
+                    eventfd_write(w->input_ready.get(), 1);
+                }
+            };
+            std::atomic<bool> replayed = false;
+            std::atomic<size_t> replay_drawn = 0; // windows done with the replay
+            // The first frame of any window ends startup, whose phases are
+            // reported then.
+            std::atomic<bool> first_frame = true;
+
+            auto render = [&](window& w, executor& ex) -> task<void> {
+                co_await ex.signalled(shared_ready.get());
+                if (quit) {
+                    ex.stop(); // the shared setup failed
+                    co_return;
+                }
+
+                // Frames are presented either through EGL or, on nodes
+                // without a usable GPU, by the CPU renderer straight into
+                // wl_shm buffers.  Buffers and presentation feedback are
+                // created through wrappers on the window's queue.
+                float resolution_vec[2] = { 640, 480 };
+                std::unique_ptr<egl_target> egl;
+                std::unique_ptr<shm_swapchain> swapchain;
+                std::unique_ptr<wl_shm, void (*)(void*)> shm_source{nullptr, wl_proxy_wrapper_destroy};
+                std::unique_ptr<wp_presentation, void (*)(void*)> feedback_source{
+                    nullptr, wl_proxy_wrapper_destroy};
+                if (presentation) {
+                    feedback_source = safe_wrapper(presentation.get(), w.queue.get());
+                }
+                std::unique_ptr<gl_renderer> renderer;
+                if (opts.present == "shm") {
+                    shm_source = safe_wrapper(shm.get(), w.queue.get());
+                    swapchain = timeline.phase("shm pool", [&]() {
+                        return std::make_unique<shm_swapchain>(shm_source.get(),
+                                                               resolution_vec[0],
+                                                               resolution_vec[1]);
+                    });
                 }
-                glDeleteShader(id);
+                else {
+                    auto surface = [&]() {
+                        egl = timeline.phase("egl surface", [&]() {
+                            return std::make_unique<egl_target>(root->share(), w.surface.get(),
+                                                                resolution_vec[0],
+                                                                resolution_vec[1]);
+                        });
+                    };
+                    if (w.index == 0) {
+                        try {
+                            surface();
+                            timeline.phase("programs", [&]() { programs.emplace(std::move(*cache)); });
+                            // Other contexts only see the programs complete
+                            // once this one is done with them.
+                            glFinish();
+                        }
+                        catch (...) {
+                            // The other windows wait on the programs; they
+                            // are woken to leave.
+                            leave();
+                            eventfd_write(programs_ready.get(), windows.size() - 1);
+                            throw;
+                        }
+                        eventfd_write(programs_ready.get(), windows.size() - 1);
+                    }
+                    else {
+                        surface();
+                        co_await ex.signalled(programs_ready.get());
+                        if (quit) {
+                            ex.stop(); // the first window failed to link the programs
+                            co_return;
+                        }
+                    }
+                    renderer = std::make_unique<gl_renderer>(*programs);
+                    // The frame callback does the pacing, so eglSwapBuffers
+                    // must not block on one of its own.
+                    eglSwapInterval(egl->egl_display(), 0);
+                }
+                auto field = device ? std::make_unique<sycl_field>(*device) : nullptr;
+                if (field && w.index == 0) {
+                    std::cerr << "SYCL device: " << field->device_name() << std::endl;
+                }
+
+                timing frame_time;
+                timing kernel_time;
+
+                // In the adaptive resolution mode frames are rendered below
+                // the window's resolution while they take longer than the
+                // target frame rate allows, and scaled up on the way out: by
+                // a blit from an offscreen target, by sampling the smaller
+                // SYCL image, or by the compositor through wp_viewport for
+                // wl_shm buffers.  Frame time is the CPU time of a frame, or
+                // the GPU time where GL_EXT_disjoint_timer_query tells,
+                // whichever is longer.
+                std::unique_ptr<resolution_governor> governor;
+                std::unique_ptr<gpu_timer> gpu;
+                std::unique_ptr<wp_viewport, void (*)(wp_viewport*)> viewport{nullptr, wp_viewport_destroy};
+                if (opts.target_fps) {
+                    if (swapchain && (!viewporter || wl_surface_get_version(w.surface.get()) <
+                                      WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION))
+                    {
+                        std::cerr << "no wp_viewporter: rendering at full resolution" << std::endl;
+                    }
+                    else {
+                        governor = std::make_unique<resolution_governor>(opts.target_fps);
+                        if (swapchain) {
+                            viewport = safe_ptr(wp_viewporter_get_viewport(viewporter.get(),
+                                                                           w.surface.get()));
+                        }
+                        else {
+                            gpu = std::make_unique<gpu_timer>();
+                        }
+                    }
+                }
+
+                // Redraws are requested through `dirty' and `wake' and paced
+                // by wl_surface.frame, so any number of events between two
+                // frames are folded into a single draw.
+                bool configured = false;
+                bool dirty = false;
+                notification wake(ex);
+
+                // One point per pointer, finger and tool in proximity.
+                point_store points;
+                tile_bins bins;
+                // Strokes of pens, fingers and the pointer with its button
+                // held, inked into a sparse canvas that the renderer mirrors
+                // tile by tile, or the CPU renderer composites.  A snapshot
+                // is taken as each stroke begins, for Ctrl+Z to go back to.
+                stroke_engine strokes;
+                tile_canvas canvas;
+                canvas_history history;
+                // Keys are looked up as keysyms; until a keymap arrives only
+                // the evdev code of Escape is known.
+                std::shared_ptr<keysym_table const> keys;
+                uint64_t keys_serial = 0;
+                uint32_t modifiers = 0;
+                key_repeat repeat;
+                auto key_action = [&](xkb_keysym_t sym, uint32_t state) noexcept {
+                    if (sym == XKB_KEY_Escape && state == WL_KEYBOARD_KEY_STATE_RELEASED) {
+                        leave();
+                    }
+                    if ((sym == XKB_KEY_z || sym == XKB_KEY_Z) && modifiers & keysym_table::control &&
+                        state == WL_KEYBOARD_KEY_STATE_PRESSED && history.undo(canvas))
+                    {
+                        dirty = true;
+                        wake.notify();
+                    }
+                };
+                // The newest input a frame consumed, on CLOCK_MONOTONIC.
+                // Replayed records carry the time of the recording and only
+                // count from when they were fed.
+                latency_stats latency;
+                uint64_t drained_at = 0;
+                uint64_t newest_input = 0;
+                auto apply = [&](input_event const& ev) noexcept {
+                    newest_input = std::max(newest_input,
+                                            replay ? ev.stamp : event_ns(ev, drained_at));
+                    auto place = [&](contact c) noexcept {
+                        points.place(contact_key(c, ev.id), ev.x, resolution_vec[1] - ev.y);
+                    };
+                    strokes.apply(ev);
+                    switch (ev.kind) {
+                    case input_kind::key: {
+                        if (auto serial = keymap_serial.load(); serial != keys_serial) {
+                            std::lock_guard lock(keymap_lock);
+                            keys = keymap;
+                            keys_serial = serial;
+                        }
+                        auto sym = keys ? keys->lookup(ev.id, modifiers)
+                            : ev.id == 1 ? XKB_KEY_Escape : XKB_KEY_NoSymbol;
+                        if (ev.value == WL_KEYBOARD_KEY_STATE_PRESSED) {
+                            if (keys && keys->repeats(ev.id)) {
+                                repeat.press(ev.id);
+                            }
+                        }
+                        else {
+                            repeat.release(ev.id);
+                        }
+                        key_action(sym, ev.value);
+                        break;
+                    }
+                    case input_kind::key_modifiers:
+                        modifiers = ev.value;
+                        break;
+                    case input_kind::key_repeat_info:
+                        repeat.configure(ev.value, ev.id);
+                        break;
+                    case input_kind::keyboard_leave:
+                        repeat.release(repeat.key());
+                        break;
+                    case input_kind::pointer_motion:
+                        place(contact::pointer);
+                        break;
+                    case input_kind::touch_down:
+                    case input_kind::touch_motion:
+                        place(contact::touch);
+                        break;
+                    case input_kind::touch_up:
+                        points.remove(contact_key(contact::touch, ev.id));
+                        break;
+                    case input_kind::touch_cancel:
+                        points.remove(contact::touch);
+                        break;
+                    case input_kind::tool_motion:
+                        place(contact::tool);
+                        break;
+                    case input_kind::tool_proximity_out:
+                        points.remove(contact_key(contact::tool, ev.id));
+                        break;
+                    default:
+                        break;
+                    }
+                };
+
+                std::optional<executor::callback> frame;
+                auto params = [&]() noexcept {
+                    auto cells = bins.data();
+                    return field_params {
+                        { resolution_vec[0], resolution_vec[1] },
+                        bins.tile_columns(),
+                        points.size(), points.xs(), points.ys(),
+                        cells.size(), cells.data(),
+                    };
+                };
+                // Only the footprints a point left and entered are repainted,
+                // and only those are reported to the compositor.
+                damage_history damage;
+                float drawn_resolution[2] = { };
+                float drawn_scale = 1;
+                uint64_t drawn_at = 0;
+                std::array<rect, damage_history::max_rects + 1> buffer_damage;
+                // Feedback arrives once the compositor showed or dropped the
+                // frame committed at `committed' (on the presentation clock).
+                // A frame shown more than a refresh period after its commit
+                // missed that many vblanks.  A listener cannot free the block
+                // it runs from, so an answered feedback is only listed, and
+                // released by the next redraw() once the dispatch returned;
+                // those still in flight go with this coroutine, before the
+                // window's queue.
+                std::vector<proxy_ptr<struct wp_presentation_feedback>> feedbacks;
+                std::vector<struct wp_presentation_feedback*> answered;
+                auto watch_presentation = [&](struct wp_presentation_feedback* feedback, uint64_t committed) {
+                    feedbacks.push_back(safe_ptr(feedback));
+                    add_listener(feedback,
+                                 [](auto) noexcept { }, // sync_output
+                                 [&, feedback, committed](uint32_t sec_hi, uint32_t sec_lo, uint32_t nsec,
+                                                          uint32_t refresh, auto, auto, auto) noexcept {
+                                     auto shown = ((static_cast<uint64_t>(sec_hi) << 32) | sec_lo) *
+                                         1'000'000'000 + nsec;
+                                     if (shown >= committed) {
+                                         latency.commit_to_present.record(shown - committed);
+                                         if (refresh) {
+                                             latency.missed_vblanks += (shown - committed) / refresh;
+                                         }
+                                     }
+                                     ++latency.presented;
+                                     answered.push_back(feedback);
+                                 },
+                                 [&, feedback]() noexcept {
+                                     ++latency.discarded;
+                                     answered.push_back(feedback);
+                                 });
+                };
+                // Returns whether a frame was committed, with `frame' pending.
+                auto redraw = [&]() {
+                    trace_scope scope("redraw");
+                    std::erase_if(feedbacks, [&](auto const& f) noexcept {
+                        return std::find(answered.begin(), answered.end(), f.get()) != answered.end();
+                    });
+                    answered.clear();
+                    auto scale = governor ? governor->scale() : 1.0f;
+                    int width = resolution_vec[0];
+                    int height = resolution_vec[1];
+                    // The size drawn at, which only the governor lowers.
+                    auto scaled_width = governor ? governor->scaled(width) : width;
+                    auto scaled_height = governor ? governor->scaled(height) : height;
+                    if (swapchain) {
+                        swapchain->resize(scaled_width, scaled_height);
+                    }
+                    auto target = swapchain ? swapchain->acquire() : nullptr;
+                    if (swapchain && !target) {
+                        return false; // every buffer is still on screen; a release retries
+                    }
+                    auto start = std::chrono::steady_clock::now();
+                    drained_at = monotonic_ns();
+                    w.inputs->drain(apply);
+                    w.tool_inputs->drain(apply);
+                    dirty = false;
+                    if (strokes.started()) {
+                        history.checkpoint(canvas);
+                    }
+                    for (auto const& d : strokes.fresh()) {
+                        canvas.stamp(d);
+                    }
+                    strokes.settle();
+                    bool resized = !std::equal(resolution_vec, resolution_vec + 2, drawn_resolution);
+                    bool moved = !points.changes().empty();
+                    bool inked = !canvas.dirty().empty();
+                    bool rescaled = scale != drawn_scale;
+                    if (!resized && !moved && !inked && !rescaled) {
+                        return false;
+                    }
+                    // Scaling up filters across neighbouring pixels of the
+                    // small image, so a change shows a little beyond where it
+                    // happened.
+                    int margin = scale < 1 ? static_cast<int>(std::ceil(1 / scale)) + 1 : 0;
+                    damage.next(width, height);
+                    if (rescaled) {
+                        damage.invalidate();
+                    }
+                    for (auto r : points.changes()) {
+                        damage.add(inflate(r, margin));
+                    }
+                    points.settle();
+                    for (auto k : canvas.dirty()) {
+                        damage.add(inflate(tile_canvas::bounds(k, height), margin));
+                    }
+                    std::copy_n(resolution_vec, 2, drawn_resolution);
+                    drawn_scale = scale;
+                    bins.build(points, width, height);
+
+                    frame.emplace(ex, wl_surface_frame(w.surface.get()));
+                    auto feedback = feedback_source
+                        ? wp_presentation_feedback(feedback_source.get(), w.surface.get())
+                        : nullptr;
+                    if (target) {
+                        // Damage is tracked in window pixels and painted and
+                        // reported in buffer pixels.
+                        auto age = target->serial ? damage.current_serial() - target->serial : 0;
+                        auto rows = target->height;
+                        for (auto r : damage.region(age)) {
+                            trace_scope rect_scope("paint");
+                            r = scale_rect(r, scale);
+                            paint(target->pixels(), target->stride(), rows, params(),
+                                  r.x0, rows - r.y1, r.x1, rows - r.y0, scale);
+                            canvas.composite(target->pixels(), target->stride(),
+                                             r.x0, rows - r.y1, r.x1, rows - r.y0, scale);
+                        }
+                        target->serial = damage.current_serial();
+                        auto current = damage.current();
+                        std::transform(current.begin(), current.end(), buffer_damage.begin(),
+                                       [scale](rect r) noexcept { return scale_rect(r, scale); });
+                        if (viewport && (resized || rescaled)) {
+                            wp_viewport_set_destination(viewport.get(), width, height);
+                        }
+                        swapchain->present(w.surface.get(), target,
+                                           { buffer_damage.data(), current.size() });
+                    }
+                    else {
+                        renderer->update(params(), scale);
+                        if (gpu) {
+                            gpu->begin();
+                        }
+                        renderer->ink(canvas);
+                        if (field) {
+                            renderer->upload(field->compute(params(), scaled_width, scaled_height, scale),
+                                             scaled_width, scaled_height);
+                            kernel_time.add(field->kernel_ns() * 1e-6);
+                            renderer->draw(damage.region(egl->buffer_age()), true);
+                        }
+                        else if (scale < 1) {
+                            renderer->draw_scaled(damage.current(), damage.region(egl->buffer_age()));
+                        }
+                        else {
+                            renderer->draw(damage.region(egl->buffer_age()), false);
+                        }
+                        if (gpu) {
+                            gpu->end();
+                        }
+                        egl->swap(damage.current());
+                    }
+                    canvas.settle();
+                    auto committed = monotonic_ns();
+                    if (first_frame.exchange(false)) {
+                        timeline.mark("first frame", drained_at, committed);
+                        std::cerr << timeline << std::endl;
+                    }
+                    if (newest_input && newest_input <= committed) {
+                        latency.input_to_commit.record(committed - newest_input);
+                    }
+                    newest_input = 0;
+                    if (feedback) {
+                        auto clock = presentation_clock.load(std::memory_order_relaxed);
+                        watch_presentation(feedback, clock_ns(clock));
+                    }
+                    auto ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start).count();
+                    frame_time.add(ms);
+                    if (governor) {
+                        governor->add(std::max(ms, gpu ? gpu->collect() : 0.0));
+                    }
+                    drawn_at = committed;
+                    return true;
+                };
+
+                auto report = [&]() {
+                    std::cerr << "window " << w.index << ":" << std::endl;
+                    std::cerr << "frame: " << frame_time << std::endl;
+                    if (field) {
+                        std::cerr << "kernel: " << kernel_time << std::endl;
+                    }
+                    if (governor) {
+                        std::cerr << *governor << std::endl;
+                    }
+                    std::cerr << canvas << ", " << history.size() << " undo steps" << std::endl;
+                    std::cerr << latency << std::endl;
+                };
+
+                // The window reports once, whether it was the one to leave
+                // or was woken to notice another did, maybe while waiting on
+                // a frame callback that may never come.
+                bool reported = false;
+                auto finish = [&]() {
+                    if (!std::exchange(reported, true)) {
+                        report();
+                        ex.stop();
+                    }
+                };
+
+                // Input wakes the frame loop through the eventfd the input
+                // and replay threads signal.
+                auto watch_input = [&]() -> task<void> {
+                    for (;;) {
+                        co_await ex.signalled(w.input_ready.get());
+                        if (quit) {
+                            finish();
+                        }
+                        dirty = true;
+                        wake.notify();
+                    }
+                };
+                auto watch_configure = [&]() -> task<void> {
+                    for (;;) {
+                        co_await ex.signalled(w.configure_ready.get());
+                        window::configure_state c;
+                        {
+                            std::lock_guard lock(w.configure_lock);
+                            c = w.latest;
+                        }
+                        if (c.width * c.height) {
+                            if (egl) {
+                                egl->resize(c.width, c.height);
+                            }
+                            resolution_vec[0] = c.width;
+                            resolution_vec[1] = c.height;
+                        }
+                        zxdg_surface_v6_ack_configure(w.xsurface.get(), c.serial);
+                        configured = true;
+                        dirty = true;
+                        wake.notify();
+                    }
+                };
+                auto frames = [&]() -> task<void> {
+                    while (!quit) {
+                        if (!configured || !dirty) {
+                            co_await wake;
+                            continue;
+                        }
+                        auto finished = replayed.load();
+                        auto committed = redraw();
+                        if (finished) {
+                            break;
+                        }
+                        if (committed) {
+                            co_await *frame;
+                            frame.reset();
+                        }
+                        else if (dirty) {
+                            co_await ex.dispatched();
+                        }
+                    }
+                };
+                // A held key repeats from the timerfd, with the keysym of the
+                // modifiers in effect at each repeat.
+                auto watch_repeat = [&]() -> task<void> {
+                    for (;;) {
+                        auto n = co_await ex.signalled(repeat.fd());
+                        for (auto k = repeat.key(); k && n; --n) {
+                            key_action(keys->lookup(k, modifiers), WL_KEYBOARD_KEY_STATE_PRESSED);
+                        }
+                    }
+                };
+                // A window that stopped drawing has headroom to spare: after
+                // a quiet spell its last picture is redrawn at full
+                // resolution.
+                auto watch_idle = [&]() -> task<void> {
+                    constexpr uint64_t quiet = 250'000'000;
+                    for (;;) {
+                        co_await ex.sleep_for(std::chrono::nanoseconds(quiet));
+                        if (monotonic_ns() - drawn_at >= quiet && governor->reset()) {
+                            dirty = true;
+                            wake.notify();
+                        }
+                    }
+                };
+                auto watch_report = [&]() -> task<void> {
+                    for (;;) {
+                        co_await ex.signalled(w.report_request.get());
+                        report();
+                    }
+                };
+                ex.spawn(watch_configure());
+                ex.spawn(watch_input());
+                ex.spawn(watch_repeat());
+                ex.spawn(watch_report());
+                if (governor) {
+                    ex.spawn(watch_idle());
+                }
+                co_await frames();
+
+                if (!replayed || replay_drawn.fetch_add(1) + 1 == windows.size()) {
+                    leave();
+                }
+                finish();
+            };
+            // Declared after all the render threads use, so they are joined
+            // before any of it goes.
+            std::vector<std::jthread> renderers;
+            for (auto& w : windows) {
+                renderers.emplace_back([&, w = w.get()]() noexcept {
+                    tracer::instance().name_thread(w->name.c_str());
+                    try {
+                        executor window_ex(display.get(), w->queue.get());
+                        window_ex.spawn(render(*w, window_ex));
+                        window_ex.run();
+                    }
+                    catch (fatal_error& ex) {
+                        std::cerr << ex << std::endl;
+                        leave();
+                    }
+                    eventfd_write(w->done.get(), 1);
+                });
+            }
+
+            try {
+                co_await ex.signalled(context_setup.fd());
+                root = context_setup.get();
+                co_await ex.signalled(cache_setup.fd());
+                cache = cache_setup.get();
+                co_await ex.signalled(field_setup.fd());
+                device = field_setup.get();
+            }
+            catch (...) {
+                quit = true;
+                eventfd_write(shared_ready.get(), windows.size());
+                throw;
+            }
+            eventfd_write(shared_ready.get(), windows.size());
+
+            queue_thread input_thread(display.get(), input_queue.get(), "input", [&]() noexcept {
+                for (auto& w : windows) {
+                    if (std::exchange(w->published, false)) {
+                        eventfd_write(w->input_ready.get(), 1);
+                    }
+                }
+            });
+            queue_thread tablet_thread(display.get(), tablet_queue.get(), "tablet", [&]() noexcept {
+                for (auto& w : windows) {
+                    if (std::exchange(w->tool_published, false)) {
+                        eventfd_write(w->input_ready.get(), 1);
+                    }
+                }
+                for (auto stylus : removed_tools) {
+                    destroy(stylus);
+                }
+                removed_tools.clear();
+            });
+
+            // The replay feeds each record to the ring of the window it was
+            // recorded for, exactly like the input thread would, and the
+            // session ends once every window has drawn its last replayed
+            // record.
+            std::jthread replay_thread;
+            if (replay) {
+                replay_thread = std::jthread([&](std::stop_token token) {
+                    replay->play(token, opts.max_speed, [&](input_event ev) noexcept {
+                        auto& w = *windows[ev.window];
+                        ev.stamp = monotonic_ns();
+                        while (!w.inputs->try_push(ev)) {
+                            eventfd_write(w.input_ready.get(), 1);
+                            if (token.stop_requested()) {
+                                return false;
+                            }
+                            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        }
+                        if (!opts.max_speed) {
+                            eventfd_write(w.input_ready.get(), 1);
+                        }
+                        return true;
+                    });
+                    replayed = true;
+                    for (auto& w : windows) {
+                        eventfd_write(w->input_ready.get(), 1);
+                    }
+                });
+            }
+
+            auto report = [&]() {
+                std::cerr << "allocations: " << allocations.load(std::memory_order_relaxed) << std::endl;
+            };
+            auto write_trace = [&]() noexcept {
+                tracer::instance().stop();
+                try {
+                    auto dropped = tracer::instance().write(trace_path);
+                    std::cerr << "trace: " << trace_path << ", " << dropped << " events dropped" << std::endl;
+                }
+                catch (fatal_error& ex) {
+                    std::cerr << ex << std::endl;
+                }
+            };
+            // Each window reports on its own thread.
+            auto watch_signal = [&]() -> task<void> {
+                for (;;) {
+                    co_await ex.readable(report_signal.get());
+                    signalfd_siginfo info;
+                    if (::read(report_signal.get(), &info, sizeof (info)) != sizeof (info)) {
+                        continue;
+                    }
+                    if (info.ssi_signo == SIGUSR2) {
+                        if (tracer::instance().enabled()) {
+                            write_trace();
+                        }
+                        else {
+                            tracer::instance().start();
+                        }
+                        continue;
+                    }
+                    for (auto& w : windows) {
+                        eventfd_write(w->report_request.get(), 1);
+                    }
+                    report();
+                }
+            };
+            ex.spawn(watch_signal());
+            for (auto& w : windows) {
+                co_await ex.signalled(w->done.get());
             }
-            return compiled;
-        };
-#define STRINGIFY(x) #x
-#define TO_STRING(x) STRINGIFY(x)
-        compile(program,
-                GL_VERTEX_SHADER,
-                TO_STRING(attribute vec4 position;
-                          varying vec2 vert;
-                          void main(void) {
-                              vert = position.xy;
-                              gl_Position = position;
-                          }));
-        compile(program,
-                GL_FRAGMENT_SHADER,
-                TO_STRING(precision mediump float;
-                          varying vec2 vert;
-                          uniform vec2 resolution;
-                          uniform vec2 pointer[16];
-                          void main(void) {
-                              float brightness = length(gl_FragCoord.xy - resolution / 2.0);
-                              brightness /= length(resolution);
-                              brightness = 1.0 - brightness;
-                              gl_FragColor = vec4(0.0, 0.0, brightness, brightness);
-                              for (int i = 0; i < 16; ++i) {
-                                  float radius = length(pointer[i] - gl_FragCoord.xy);
-                                  float touchMark = smoothstep(16.0, 40.0, radius);
-                                  gl_FragColor *= touchMark;
-                              }
-                          }));
-#undef TO_STRING
-#undef STRINGIFY
-        glBindAttribLocation(program, 0, "position");
-        auto link = [](auto program) noexcept {
-            glLinkProgram(program);
-            GLint linked;
-            glGetProgramiv(program, GL_LINK_STATUS, &linked);
-            return linked;
-        };
-        link(program);
-        glUseProgram(program);
-        glFrontFace(GL_CW);
 
-        do {
-            if (key == 1 && state == 0) {
-                return 0;
+            if (tracer::instance().enabled()) {
+                write_trace();
             }
-            glClearColor(0.0, 0.0, 0.8, 0.8);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glUseProgram(program);
-            glUniform2fv(glGetUniformLocation(program, "resolution"), 1, resolution_vec);
-            glUniform2fv(glGetUniformLocation(program, "pointer"), 16, &pointer_vec[0][0]);
-            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0,
-                                  std::array<float, 12>(
-                                      {
-                                          -1, +1, 0,
-                                          +1, +1, 0,
-                                          +1, -1, 0,
-                                          -1, -1, 0,
-                                      }).data());
-            glEnableVertexAttribArray(0);
-            glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-            eglSwapBuffers(egl_display.get(), egl_surface.get());
-        } while (wl_display_dispatch(display.get()) != -1);
-        eglMakeCurrent(egl_display.get(), nullptr, nullptr, nullptr);
+            report();
+            ex.stop();
+        };
+        ex.spawn(session());
+        ex.run();
         return 0;
     }
     catch (fatal_error& ex) {
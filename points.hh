@@ -0,0 +1,148 @@
+#ifndef INCLUDE_POINTS_HH_
+#define INCLUDE_POINTS_HH_
+
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "damage.hh"
+
+namespace
+{
+    // Side of the square screen tiles the points are binned into.  The
+    // shader hard-codes the same value.
+    constexpr int tile_size = 64;
+
+    // Contacts are keyed by their device class and the id the protocol
+    // gives them, so no two fingers or tools can ever share a point.
+    enum class contact : uint32_t {
+        pointer,
+        touch,
+        tool,
+    };
+    constexpr uint64_t contact_key(contact c, int32_t id) noexcept {
+        return (static_cast<uint64_t>(c) << 32) | static_cast<uint32_t>(id);
+    }
+
+    // Every live contact as structure-of-arrays, bottom-left origin.  A
+    // contact takes a point on its first position and gives it up on up or
+    // cancel; the last point moves into the hole.  Lookups scan `keys',
+    // which for even a crowded touch table is a few cache lines.  The
+    // footprints every change touched accumulate until settle().
+    class point_store {
+    public:
+        void place(uint64_t key, float x, float y) {
+            auto i = this->find(key);
+            if (i == this->keys.size()) {
+                this->keys.push_back(key);
+                this->x.push_back(x);
+                this->y.push_back(y);
+            }
+            else {
+                if (this->x[i] == x && this->y[i] == y) {
+                    return;
+                }
+                this->changed.push_back(footprint(this->x[i], this->y[i]));
+                this->x[i] = x;
+                this->y[i] = y;
+            }
+            this->changed.push_back(footprint(x, y));
+        }
+        void remove(uint64_t key) {
+            auto i = this->find(key);
+            if (i != this->keys.size()) {
+                this->erase(i);
+            }
+        }
+        // Drops every contact of class `c', as wl_touch.cancel asks.
+        void remove(contact c) {
+            for (size_t i = 0; i < this->keys.size(); ) {
+                if (this->keys[i] >> 32 == static_cast<uint32_t>(c)) {
+                    this->erase(i);
+                }
+                else {
+                    ++i;
+                }
+            }
+        }
+
+        size_t size() const noexcept { return this->keys.size(); }
+        float const* xs() const noexcept { return this->x.data(); }
+        float const* ys() const noexcept { return this->y.data(); }
+        // Where the field changed since the last settle().
+        std::span<rect const> changes() const noexcept { return this->changed; }
+        void settle() noexcept { this->changed.clear(); }
+
+    private:
+        size_t find(uint64_t key) const noexcept {
+            return std::find(this->keys.begin(), this->keys.end(), key) - this->keys.begin();
+        }
+        void erase(size_t i) {
+            this->changed.push_back(footprint(this->x[i], this->y[i]));
+            this->keys[i] = this->keys.back();
+            this->x[i] = this->x.back();
+            this->y[i] = this->y.back();
+            this->keys.pop_back();
+            this->x.pop_back();
+            this->y.pop_back();
+        }
+
+        std::vector<uint64_t> keys;
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<rect> changed;
+    };
+
+    // Per-tile lists of the points whose footprint reaches into the tile,
+    // rebuilt each frame by a counting sort.  `cells' holds the offsets
+    // first, one per tile plus an end marker, indexing into the point
+    // indices stored behind them: tile t lists cells[cells[t]] up to
+    // cells[cells[t + 1]].  Storage is kept between frames.
+    class tile_bins {
+    public:
+        void build(point_store const& points, int width, int height) {
+            this->columns = (width + tile_size - 1) / tile_size;
+            this->rows = (height + tile_size - 1) / tile_size;
+            auto tiles = static_cast<size_t>(this->columns) * this->rows;
+            this->cells.assign(tiles + 1, 0);
+            auto each = [&](auto f) {
+                for (size_t i = 0; i < points.size(); ++i) {
+                    auto r = footprint(points.xs()[i], points.ys()[i]);
+                    if (r.x1 <= 0 || r.y1 <= 0) {
+                        continue;
+                    }
+                    auto c0 = std::max(r.x0, 0) / tile_size;
+                    auto r0 = std::max(r.y0, 0) / tile_size;
+                    auto c1 = std::min((r.x1 - 1) / tile_size, this->columns - 1);
+                    auto r1 = std::min((r.y1 - 1) / tile_size, this->rows - 1);
+                    for (int row = r0; row <= r1; ++row) {
+                        for (int col = c0; col <= c1; ++col) {
+                            f(static_cast<size_t>(row) * this->columns + col, i);
+                        }
+                    }
+                }
+            };
+            each([&](size_t t, size_t) noexcept { ++this->cells[t + 1]; });
+            // Turn the counts into absolute offsets past the offset table.
+            this->cells[0] = tiles + 1;
+            for (size_t t = 1; t <= tiles; ++t) {
+                this->cells[t] += this->cells[t - 1];
+            }
+            this->cells.resize(this->cells[tiles]);
+            this->fill.assign(this->cells.begin(), this->cells.begin() + tiles);
+            each([&](size_t t, size_t i) noexcept { this->cells[this->fill[t]++] = i; });
+        }
+
+        int tile_columns() const noexcept { return this->columns; }
+        std::span<uint32_t const> data() const noexcept { return this->cells; }
+
+    private:
+        int columns = 0;
+        int rows = 0;
+        std::vector<uint32_t> cells;
+        std::vector<uint32_t> fill;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_POINTS_HH_*/
@@ -0,0 +1,247 @@
+#ifndef INCLUDE_PROGRAM_CACHE_HH_
+#define INCLUDE_PROGRAM_CACHE_HH_
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <GLES3/gl3.h>
+
+#include "safe.hh"
+
+namespace
+{
+    inline void compile_shader(GLuint program, GLenum shader_type, char const* code,
+                               location loc = location::current())
+    {
+        auto id = glCreateShader(shader_type);
+        if (!id) {
+            throw fatal_error("cannot create shader", loc);
+        }
+        glShaderSource(id, 1, &code, nullptr);
+        glCompileShader(id);
+        GLint compiled = 0;
+        glGetShaderiv(id, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            GLint length = 0;
+            glGetShaderiv(id, GL_INFO_LOG_LENGTH, &length);
+            std::string log(length, '\0');
+            glGetShaderInfoLog(id, length, nullptr, log.data());
+            glDeleteShader(id);
+            throw fatal_error(("shader compilation failed: " + log).c_str(), loc);
+        }
+        glAttachShader(program, id);
+        glDeleteShader(id);
+    }
+    inline void link_program(GLuint program, location loc = location::current()) {
+        glLinkProgram(program);
+        GLint linked = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            GLint length = 0;
+            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+            std::string log(length, '\0');
+            glGetProgramInfoLog(program, length, nullptr, log.data());
+            throw fatal_error(("program link failed: " + log).c_str(), loc);
+        }
+    }
+
+    // Linked programs kept on disk as glGetProgramBinary blobs, one file per
+    // program under $XDG_CACHE_HOME/wayland-sycl-client (~/.cache when
+    // unset).  A file is named by a hash of the shader sources and holds a
+    // hash of the driver's vendor, renderer, version and binary formats, so
+    // a driver update never sees a stale blob; the format a blob was saved
+    // in is stored with it.  build() reads just the file of the program it
+    // builds, and a blob the driver rejects or another driver saved is
+    // overwritten by a fresh build, so the cache holds one blob per program.
+    // Without a cache directory, or binary formats, build() just compiles.
+    //
+    // Construction only makes the directory and may run on any thread
+    // before a GL context exists; build() needs the context current.
+    class program_cache {
+    public:
+        using stage = std::pair<GLenum, char const*>;
+
+        program_cache()
+            : writable{make_directory(this->directory)}
+            {
+            }
+
+        // A linked program of `stages', from the cache when it has one.
+        GLuint build(std::initializer_list<stage> stages) {
+            if (!this->probed) {
+                this->probe();
+            }
+            auto program = glCreateProgram();
+            if (!this->enabled) {
+                compile(program, stages);
+                return program;
+            }
+            auto key = hash("");
+            for (auto [type, code] : stages) {
+                key = hash({ reinterpret_cast<char const*>(&type), sizeof (type) }, key);
+                key = hash(code, key);
+            }
+            auto path = this->path(key);
+            if (auto blob = read(::open(path.c_str(), O_RDONLY | O_CLOEXEC), this->driver);
+                !blob.empty() && load(program, blob))
+            {
+                return program;
+            }
+            glDeleteProgram(program);
+            program = glCreateProgram();
+            glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            compile(program, stages);
+            store(program, path, this->driver);
+            return program;
+        }
+
+    private:
+        struct blob_header {
+            char magic[8];
+            uint64_t driver;
+            uint32_t format;
+            uint32_t size;
+        };
+        static constexpr char blob_magic[8] = { 'W', 'S', 'C', 'P', 'R', 'G', '\0', '\2' };
+        static constexpr size_t max_blob = 16 << 20;
+
+        void probe() {
+            this->probed = true;
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            if (formats == 0 || !this->writable) {
+                return;
+            }
+            std::vector<GLint> list(formats);
+            glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, list.data());
+            for (auto name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+                auto s = reinterpret_cast<char const*>(glGetString(name));
+                this->driver = hash(s ? s : "", this->driver);
+            }
+            this->driver = hash({ reinterpret_cast<char const*>(list.data()),
+                                  list.size() * sizeof (GLint) }, this->driver);
+            this->enabled = true;
+        }
+        static void compile(GLuint program, std::initializer_list<stage> stages) {
+            for (auto [type, code] : stages) {
+                compile_shader(program, type, code);
+            }
+            link_program(program);
+        }
+        // FNV-1a.
+        static uint64_t hash(std::string_view bytes, uint64_t h = 14695981039346656037u) noexcept {
+            for (unsigned char c : bytes) {
+                h = (h ^ c) * 1099511628211u;
+            }
+            return h;
+        }
+        std::string path(uint64_t key) const {
+            char name[24];
+            std::snprintf(name, sizeof (name), "/%016llx.bin", static_cast<unsigned long long>(key));
+            return this->directory + name;
+        }
+        static bool make_directory(std::string& directory) {
+            if (auto xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg == '/') {
+                directory = xdg;
+            }
+            else if (auto home = std::getenv("HOME"); home && *home) {
+                directory = std::string(home) + "/.cache";
+            }
+            else {
+                return false;
+            }
+            directory += "/wayland-sycl-client";
+            for (auto i = directory.find('/', 1); ; i = directory.find('/', i + 1)) {
+                auto part = directory.substr(0, i);
+                if (::mkdir(part.c_str(), 0700) != 0 && errno != EEXIST) {
+                    return false;
+                }
+                if (i == std::string::npos) {
+                    return true;
+                }
+            }
+        }
+        // The whole of a blob file, or nothing if it is not one or `driver'
+        // did not save it.
+        static std::vector<char> read(int fd, uint64_t driver) {
+            if (fd < 0) {
+                return { };
+            }
+            safe_fd file(fd);
+            blob_header header;
+            if (::read(fd, &header, sizeof (header)) != sizeof (header) ||
+                std::memcmp(header.magic, blob_magic, sizeof (blob_magic)) != 0 ||
+                header.driver != driver || header.size > max_blob)
+            {
+                return { };
+            }
+            std::vector<char> blob(sizeof (header) + header.size);
+            std::memcpy(blob.data(), &header, sizeof (header));
+            if (::read(fd, blob.data() + sizeof (header), header.size) !=
+                static_cast<ssize_t>(header.size))
+            {
+                return { };
+            }
+            return blob;
+        }
+        static bool load(GLuint program, std::vector<char> const& blob) noexcept {
+            blob_header header;
+            std::memcpy(&header, blob.data(), sizeof (header));
+            glProgramBinary(program, header.format, blob.data() + sizeof (header), header.size);
+            GLint linked = 0;
+            glGetProgramiv(program, GL_LINK_STATUS, &linked);
+            return linked;
+        }
+        // Written aside and renamed into place, over the blob it replaces,
+        // so a concurrent launch never reads half a blob.
+        static void store(GLuint program, std::string const& path, uint64_t driver) {
+            GLint size = 0;
+            glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+            if (size <= 0) {
+                return;
+            }
+            blob_header header;
+            std::memcpy(header.magic, blob_magic, sizeof (blob_magic));
+            header.driver = driver;
+            std::vector<char> binary(size);
+            GLenum format = 0;
+            glGetProgramBinary(program, size, &size, &format, binary.data());
+            header.format = format;
+            header.size = size;
+            auto temporary = path + '.' + std::to_string(::getpid());
+            auto fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+            if (fd < 0) {
+                return;
+            }
+            bool written;
+            {
+                safe_fd file(fd);
+                written = ::write(fd, &header, sizeof (header)) == sizeof (header) &&
+                    ::write(fd, binary.data(), size) == size;
+            }
+            if (!written || ::rename(temporary.c_str(), path.c_str()) != 0) {
+                ::unlink(temporary.c_str());
+            }
+        }
+
+        std::string directory;
+        uint64_t driver = hash("");
+        bool writable = false;
+        bool probed = false;
+        bool enabled = false;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_PROGRAM_CACHE_HH_*/
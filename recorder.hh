@@ -0,0 +1,211 @@
+#ifndef INCLUDE_RECORDER_HH_
+#define INCLUDE_RECORDER_HH_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <ostream>
+#include <stop_token>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "safe.hh"
+#include "input.hh"
+
+namespace
+{
+    // On-disk layout of a recording: this header on its own cache line,
+    // followed by `capacity' input_event records used as a ring.  `written'
+    // counts every record ever stored, so the oldest surviving record is
+    // at written - capacity once the ring has wrapped.
+    struct recording_header {
+        char magic[8];
+        uint32_t record_size;
+        uint32_t reserved;
+        uint64_t capacity;
+        std::atomic<uint64_t> written;
+    };
+    static_assert(sizeof (recording_header) <= cache_line_size);
+    static_assert(std::atomic<uint64_t>::is_always_lock_free);
+    constexpr char recording_magic[8] = { 'W', 'S', 'C', 'R', 'E', 'C', '\0', '\1' };
+
+    class recording_map {
+    public:
+        recording_map(void* base, size_t size) noexcept : base{base}, size{size} { }
+        recording_map(recording_map&& rhs) noexcept
+            : base{std::exchange(rhs.base, nullptr)}, size{rhs.size}
+            {
+            }
+        ~recording_map() noexcept { if (this->base) ::munmap(this->base, this->size); }
+        auto header() const noexcept { return static_cast<recording_header*>(this->base); }
+        auto records() const noexcept {
+            return reinterpret_cast<input_event*>(static_cast<char*>(this->base) + cache_line_size);
+        }
+    private:
+        void* base;
+        size_t size;
+    };
+
+    inline auto map_recording(int fd, size_t size, int prot, location loc = location::current()) {
+        auto base = ::mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            throw fatal_error("bad mapping", loc);
+        }
+        return recording_map(base, size);
+    }
+
+    // Appends records to a memory-mapped ring file.  write() is an atomic
+    // slot reservation and a copy: no lock, allocation, formatting or system
+    // call on the input path, and several input threads may share one
+    // recorder.  The kernel writes the pages back on its own schedule.
+    class input_recorder {
+    public:
+        explicit input_recorder(char const* path, uint64_t capacity = 1 << 20)
+            : map{open(path, capacity)}
+            {
+            }
+        void write(input_event const& ev) noexcept {
+            auto header = this->map.header();
+            auto n = header->written.fetch_add(1, std::memory_order_relaxed);
+            this->map.records()[n % header->capacity] = ev;
+        }
+
+    private:
+        static recording_map open(char const* path, uint64_t capacity) {
+            auto fd = safe_fd(::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+            auto size = cache_line_size + capacity * sizeof (input_event);
+            if (::ftruncate(fd.get(), size) == -1) {
+                throw fatal_error("cannot size the recording", location::current());
+            }
+            auto map = map_recording(fd.get(), size, PROT_READ | PROT_WRITE);
+            auto header = map.header();
+            std::memcpy(header->magic, recording_magic, sizeof (recording_magic));
+            header->record_size = sizeof (input_event);
+            header->capacity = capacity;
+            header->written.store(0, std::memory_order_release);
+            return map;
+        }
+        recording_map map;
+    };
+
+    // Read-only view of a recording, oldest surviving record first.
+    class input_recording {
+    public:
+        explicit input_recording(char const* path) : map{open(path)} { }
+        uint64_t size() const noexcept {
+            auto header = this->map.header();
+            return std::min(header->written.load(std::memory_order_acquire), header->capacity);
+        }
+        input_event const& operator[](uint64_t i) const noexcept {
+            auto header = this->map.header();
+            auto first = header->written.load(std::memory_order_acquire) - this->size();
+            return this->map.records()[(first + i) % header->capacity];
+        }
+        // The number of windows the records went to, by the highest index.
+        size_t windows() const noexcept {
+            size_t n = 0;
+            for (uint64_t i = 0; i < this->size(); ++i) {
+                n = std::max(n, (*this)[i].window + size_t{1});
+            }
+            return n;
+        }
+        // Feeds every record to `feed', either as fast as it accepts them or
+        // spaced by their original receipt stamps.  Stops early when `feed'
+        // returns false or a stop is requested.
+        template <class F>
+        void play(std::stop_token token, bool max_speed, F&& feed) const {
+            auto n = this->size();
+            if (!n) {
+                return;
+            }
+            auto origin = (*this)[0].stamp;
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < n && !token.stop_requested(); ++i) {
+                auto const& ev = (*this)[i];
+                if (!max_speed) {
+                    std::this_thread::sleep_until(start + std::chrono::nanoseconds(ev.stamp - origin));
+                }
+                if (!feed(ev)) {
+                    return;
+                }
+            }
+        }
+
+    private:
+        static recording_map open(char const* path) {
+            auto fd = safe_fd(::open(path, O_RDONLY | O_CLOEXEC));
+            struct stat st;
+            if (::fstat(fd.get(), &st) == -1 ||
+                static_cast<size_t>(st.st_size) < cache_line_size)
+            {
+                throw fatal_error("not a recording", location::current());
+            }
+            auto map = map_recording(fd.get(), st.st_size, PROT_READ);
+            auto header = map.header();
+            if (std::memcmp(header->magic, recording_magic, sizeof (recording_magic)) ||
+                header->record_size != sizeof (input_event) ||
+                cache_line_size + header->capacity * sizeof (input_event) >
+                static_cast<size_t>(st.st_size))
+            {
+                throw fatal_error("not a recording", location::current());
+            }
+            return map;
+        }
+        recording_map map;
+    };
+
+    inline char const* name(input_kind kind) noexcept {
+        switch (kind) {
+        case input_kind::key:                   return "key";
+        case input_kind::pointer_motion:        return "pointer motion";
+        case input_kind::pointer_button:        return "pointer button";
+        case input_kind::pointer_axis:          return "pointer axis";
+        case input_kind::pointer_axis_source:   return "pointer axis_source";
+        case input_kind::pointer_axis_stop:     return "pointer axis_stop";
+        case input_kind::pointer_axis_discrete: return "pointer axis_discrete";
+        case input_kind::pointer_frame:         return "pointer frame";
+        case input_kind::touch_down:            return "touch down";
+        case input_kind::touch_up:              return "touch up";
+        case input_kind::touch_motion:          return "touch motion";
+        case input_kind::touch_frame:           return "touch frame";
+        case input_kind::touch_cancel:          return "touch cancel";
+        case input_kind::tool_proximity_in:     return "tool proximity_in";
+        case input_kind::tool_proximity_out:    return "tool proximity_out";
+        case input_kind::tool_down:             return "tool down";
+        case input_kind::tool_up:               return "tool up";
+        case input_kind::tool_motion:           return "tool motion";
+        case input_kind::tool_pressure:         return "tool pressure";
+        case input_kind::tool_distance:         return "tool distance";
+        case input_kind::tool_tilt:             return "tool tilt";
+        case input_kind::tool_rotation:         return "tool rotation";
+        case input_kind::tool_slider:           return "tool slider";
+        case input_kind::tool_wheel:            return "tool wheel";
+        case input_kind::tool_button:           return "tool button";
+        case input_kind::tool_frame:            return "tool frame";
+        case input_kind::key_modifiers:         return "key modifiers";
+        case input_kind::key_repeat_info:       return "key repeat_info";
+        case input_kind::keyboard_leave:        return "keyboard leave";
+        }
+        return "unknown";
+    }
+
+    // The offline text view of a record, one line per event.
+    template <class Ch>
+    auto& operator<<(std::basic_ostream<Ch>& output, input_event const& ev) {
+        return output << ev.stamp / 1'000'000'000 << '.'
+                      << std::to_string(1'000'000'000 + ev.stamp % 1'000'000'000).substr(1) << ' '
+                      << name(ev.kind) << ": "
+                      << "window=" << ev.window << ' '
+                      << "time=" << ev.time << ' '
+                      << "id=" << ev.id << ' '
+                      << "value=" << ev.value << ' '
+                      << '(' << ev.x << ' ' << ev.y << ')';
+    }
+} // ::(anonymous)
+
+#endif/*INCLUDE_RECORDER_HH_*/
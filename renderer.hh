@@ -0,0 +1,423 @@
+#ifndef INCLUDE_RENDERER_HH_
+#define INCLUDE_RENDERER_HH_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <GLES3/gl3.h>
+
+#include "safe.hh"
+#include "field.hh"
+#include "damage.hh"
+#include "canvas.hh"
+#include "program-cache.hh"
+#include "trace.hh"
+
+namespace
+{
+    // The programs every gl_renderer draws with, linked once and used by
+    // all contexts of a share group (see egl_context::share), which frees
+    // them with its last context.  Sampler units and the `frame' block
+    // binding are program state and set here, once.
+    struct gl_programs {
+        // Needs a context of the group current; `cache' may have been read
+        // from disk on another thread while the context was being made.
+        explicit gl_programs(program_cache cache) {
+#define STRINGIFY(x) #x
+#define TO_STRING(x) STRINGIFY(x)
+            auto const vertex_code = "#version 300 es\n"
+                TO_STRING(layout(location = 0) in vec4 position;
+                          void main(void) {
+                              gl_Position = position;
+                          });
+            this->program = cache.build({
+                    { GL_VERTEX_SHADER, vertex_code },
+                    { GL_FRAGMENT_SHADER,
+                      "#version 300 es\n"
+                      TO_STRING(precision mediump float;
+                                precision highp int;
+                                layout(std140) uniform frame {
+                                    vec2 resolution;
+                                    int columns;
+                                    float scale;
+                                };
+                                uniform highp sampler2D points;
+                                uniform highp usampler2D cells;
+                                uniform sampler2D ink;
+                                out vec4 color;
+                                ivec2 at(uint i) {
+                                    return ivec2(int(i % 1024u), int(i / 1024u));
+                                }
+                                void main(void) {
+                                    highp vec2 p = gl_FragCoord.xy / scale;
+                                    float brightness = length(p - resolution / 2.0);
+                                    brightness /= length(resolution);
+                                    brightness = 1.0 - brightness;
+                                    color = vec4(0.0, 0.0, brightness, brightness);
+                                    ivec2 tile = ivec2(p) / 64;
+                                    uint t = uint(tile.y * columns + tile.x);
+                                    uint end = texelFetch(cells, at(t + 1u), 0).r;
+                                    for (uint i = texelFetch(cells, at(t), 0).r; i < end; ++i) {
+                                        uint k = texelFetch(cells, at(i), 0).r;
+                                        highp vec2 point = texelFetch(points, at(k), 0).xy;
+                                        float radius = length(point - p);
+                                        float touchMark = smoothstep(16.0, 40.0, radius);
+                                        color *= touchMark;
+                                    }
+                                    float a = texelFetch(ink, ivec2(p.x, resolution.y - p.y), 0).r;
+                                    color = color * (1.0 - a) + vec4(a);
+                                }) },
+                });
+            // With the SYCL backend the field is computed by a kernel and GL
+            // only samples the uploaded image, which is filtered so that one
+            // computed below the window size is scaled up smoothly.
+            this->blit = cache.build({
+                    { GL_VERTEX_SHADER, vertex_code },
+                    { GL_FRAGMENT_SHADER,
+                      "#version 300 es\n"
+                      TO_STRING(precision mediump float;
+                                layout(std140) uniform frame {
+                                    vec2 resolution;
+                                    int columns;
+                                    float scale;
+                                };
+                                uniform sampler2D field;
+                                uniform sampler2D ink;
+                                out vec4 color;
+                                void main(void) {
+                                    color = texture(field, gl_FragCoord.xy / resolution);
+                                    float a = texelFetch(ink, ivec2(gl_FragCoord.x, resolution.y - gl_FragCoord.y),
+                                                         0).r;
+                                    color = color * (1.0 - a) + vec4(a);
+                                }) },
+                });
+#undef TO_STRING
+#undef STRINGIFY
+
+            for (auto id : { this->program, this->blit }) {
+                glUniformBlockBinding(id, glGetUniformBlockIndex(id, "frame"), 0);
+            }
+            glUseProgram(this->blit);
+            glUniform1i(glGetUniformLocation(this->blit, "field"), 0);
+            glUniform1i(glGetUniformLocation(this->blit, "ink"), 3);
+            glUseProgram(this->program);
+            glUniform1i(glGetUniformLocation(this->program, "points"), 1);
+            glUniform1i(glGetUniformLocation(this->program, "cells"), 2);
+            glUniform1i(glGetUniformLocation(this->program, "ink"), 3);
+            glUseProgram(0);
+        }
+
+        GLuint program = 0; // the field
+        GLuint blit = 0;
+    };
+
+    // Owns every GL object a window draws with but the programs.
+    // Everything that does not change per frame is set up once: the quad
+    // lives in a VBO behind a VAO, and the resolution lives in a uniform
+    // buffer read by all programs.  Points and their tile lists (see
+    // tile_bins) are texel-fetched from two textures laid out in rows of
+    // `row_texels', so each fragment only visits the points that can reach
+    // its tile.  The ink of a tile_canvas is mirrored in a texture, top row
+    // first, that both programs lay over the field; each frame uploads just
+    // the tiles the canvas changed, so the cost of a frame does not depend
+    // on how much has been drawn before.  Below full resolution the field is
+    // drawn into an offscreen target of the smaller size and blitted up.
+    class gl_renderer {
+    public:
+        // Needs a context of the group `programs' was linked in current.
+        explicit gl_renderer(gl_programs const& programs) {
+            this->program = programs.program;
+            this->blit = programs.blit;
+            glUseProgram(this->program);
+            this->current = this->program;
+
+            glGenBuffers(1, &this->ubo);
+            glBindBuffer(GL_UNIFORM_BUFFER, this->ubo);
+            glBufferData(GL_UNIFORM_BUFFER, sizeof (this->shadow), &this->shadow,
+                         GL_DYNAMIC_DRAW);
+            glBindBufferBase(GL_UNIFORM_BUFFER, 0, this->ubo);
+
+            constexpr float quad[] = {
+                -1, +1, 0,
+                +1, +1, 0,
+                +1, -1, 0,
+                -1, -1, 0,
+            };
+            glGenVertexArrays(1, &this->vao);
+            glBindVertexArray(this->vao);
+            glGenBuffers(1, &this->vbo);
+            glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+            glBufferData(GL_ARRAY_BUFFER, sizeof (quad), quad, GL_STATIC_DRAW);
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+            glEnableVertexAttribArray(0);
+
+            // Float and integer textures are only complete with nearest
+            // filtering, which texelFetch ignores anyway.
+            for (auto texture : { &this->texture, &this->points, &this->cells, &this->ink_texture,
+                                  &this->scaled })
+            {
+                glGenTextures(1, texture);
+                glBindTexture(GL_TEXTURE_2D, *texture);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            }
+
+            glBindTexture(GL_TEXTURE_2D, this->texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            glGenFramebuffers(1, &this->ink_fbo);
+            glGenFramebuffers(1, &this->scaled_fbo);
+
+            glFrontFace(GL_CW);
+        }
+        ~gl_renderer() noexcept {
+            glDeleteFramebuffers(1, &this->scaled_fbo);
+            glDeleteTextures(1, &this->scaled);
+            glDeleteFramebuffers(1, &this->ink_fbo);
+            glDeleteTextures(1, &this->ink_texture);
+            glDeleteTextures(1, &this->cells);
+            glDeleteTextures(1, &this->points);
+            glDeleteTextures(1, &this->texture);
+            glDeleteBuffers(1, &this->vbo);
+            glDeleteVertexArrays(1, &this->vao);
+            glDeleteBuffers(1, &this->ubo);
+        }
+        gl_renderer(gl_renderer const&) = delete;
+        gl_renderer& operator=(gl_renderer const&) = delete;
+
+        // Stages the resolution and the `scale' draw_scaled() renders the
+        // field at, which only reach the driver at the next draw if they
+        // changed, and uploads the points and tile lists.
+        void update(field_params const& p, float scale = 1) {
+            trace_scope scope("point upload");
+            if (this->shadow.resolution[0] != p.resolution[0] ||
+                this->shadow.resolution[1] != p.resolution[1] ||
+                this->shadow.columns != p.tile_columns ||
+                this->shadow.scale != scale)
+            {
+                this->shadow.resolution[0] = p.resolution[0];
+                this->shadow.resolution[1] = p.resolution[1];
+                this->shadow.columns = p.tile_columns;
+                this->shadow.scale = scale;
+                this->stale = true;
+                glViewport(0, 0, p.resolution[0], p.resolution[1]);
+            }
+            // x and y interleave into RG32F texels.
+            this->staging.resize(2 * p.point_count);
+            for (size_t i = 0; i < p.point_count; ++i) {
+                this->staging[2 * i] = p.x[i];
+                this->staging[2 * i + 1] = p.y[i];
+            }
+            load(GL_TEXTURE1, this->points, this->points_size, GL_RG32F, GL_RG, GL_FLOAT,
+                 this->staging.data(), p.point_count, 2 * sizeof (float));
+            load(GL_TEXTURE2, this->cells, this->cells_size,
+                 GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT,
+                 p.cells, p.cell_count, sizeof (uint32_t));
+        }
+        // Uploads a bottom-row-first RGBA8 image for the blit program.
+        void upload(uint32_t const* pixels, int width, int height) noexcept {
+            trace_scope scope("image upload");
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, this->texture);
+            if (this->texture_size[0] != width || this->texture_size[1] != height) {
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0,
+                             GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+                this->texture_size[0] = width;
+                this->texture_size[1] = height;
+            }
+            else {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                                GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+            }
+        }
+        // Brings the ink texture up to date with `canvas': the tiles it
+        // lists dirty, or every tile after a resize.  Tiles restore() dropped
+        // are cleared.  Needs the resolution staged by update().
+        void ink(tile_canvas& canvas) {
+            constexpr int side = tile_canvas::canvas_tile;
+            int width = this->shadow.resolution[0];
+            int height = this->shadow.resolution[1];
+            glActiveTexture(GL_TEXTURE3);
+            glBindTexture(GL_TEXTURE_2D, this->ink_texture);
+            glActiveTexture(GL_TEXTURE0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, side);
+            auto load = [&](tile_canvas::key k, uint8_t const* coverage) noexcept {
+                int left = static_cast<uint32_t>(k) * side;
+                int top = static_cast<uint32_t>(k >> 32) * side;
+                auto w = std::min(side, width - left);
+                auto h = std::min(side, height - top);
+                if (w > 0 && h > 0) {
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, left, top, w, h,
+                                    GL_RED, GL_UNSIGNED_BYTE, coverage);
+                }
+            };
+            if (this->ink_size[0] != width || this->ink_size[1] != height) {
+                trace_scope scope("ink upload");
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0,
+                             GL_RED, GL_UNSIGNED_BYTE, nullptr);
+                glBindFramebuffer(GL_FRAMEBUFFER, this->ink_fbo);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                                       this->ink_texture, 0);
+                glClearColor(0, 0, 0, 0);
+                glClear(GL_COLOR_BUFFER_BIT);
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                this->ink_size[0] = width;
+                this->ink_size[1] = height;
+                canvas.each([&](auto k, auto const& t) noexcept { load(k, t.coverage); });
+            }
+            else if (auto dirty = canvas.dirty(); !dirty.empty()) {
+                trace_scope scope("ink upload");
+                static tile_canvas::tile const blank = { };
+                for (auto k : dirty) {
+                    auto t = canvas.find(k);
+                    load(k, (t ? t : &blank)->coverage);
+                }
+            }
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+        // Draws the field, or the uploaded image when `textured', into each
+        // rectangle of `region'.
+        void draw(std::span<rect const> region, bool textured) noexcept {
+            trace_scope scope("glDrawArrays field");
+            auto id = textured ? this->blit : this->program;
+            if (this->current != id) {
+                glUseProgram(id);
+                this->current = id;
+            }
+            this->flush();
+            glEnable(GL_SCISSOR_TEST);
+            for (auto r : region) {
+                glScissor(r.x0, r.y0, r.width(), r.height());
+                glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+            }
+            glDisable(GL_SCISSOR_TEST);
+            // The offscreen target of draw_scaled() misses what is drawn here.
+            this->scaled_stale = true;
+        }
+        // Draws the field at the scale staged by update() into an offscreen
+        // target, where only `changed' needs redrawing unless the target was
+        // just made or draw() ran since, and scales it up into each
+        // rectangle of `region'.
+        void draw_scaled(std::span<rect const> changed, std::span<rect const> region) noexcept {
+            trace_scope scope("glDrawArrays scaled");
+            int width = this->shadow.resolution[0];
+            int height = this->shadow.resolution[1];
+            int w = std::max(static_cast<int>(std::ceil(width * this->shadow.scale)), 1);
+            int h = std::max(static_cast<int>(std::ceil(height * this->shadow.scale)), 1);
+            rect everything = { 0, 0, width, height };
+            if (this->scaled_size[0] != w || this->scaled_size[1] != h) {
+                glActiveTexture(GL_TEXTURE4);
+                glBindTexture(GL_TEXTURE_2D, this->scaled);
+                glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                glActiveTexture(GL_TEXTURE0);
+                glBindFramebuffer(GL_FRAMEBUFFER, this->scaled_fbo);
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                                       this->scaled, 0);
+                this->scaled_size[0] = w;
+                this->scaled_size[1] = h;
+                this->scaled_stale = true;
+            }
+            if (std::exchange(this->scaled_stale, false)) {
+                changed = { &everything, 1 };
+            }
+            if (this->current != this->program) {
+                glUseProgram(this->program);
+                this->current = this->program;
+            }
+            this->flush();
+            glBindFramebuffer(GL_FRAMEBUFFER, this->scaled_fbo);
+            glViewport(0, 0, w, h);
+            glEnable(GL_SCISSOR_TEST);
+            for (auto r : changed) {
+                r = scale_rect(r, this->shadow.scale);
+                glScissor(r.x0, r.y0, r.width(), r.height());
+                glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
+            }
+            glViewport(0, 0, width, height);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+            for (auto r : region) {
+                glScissor(r.x0, r.y0, r.width(), r.height());
+                glBlitFramebuffer(0, 0, w, h, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+            }
+            glDisable(GL_SCISSOR_TEST);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+
+    private:
+        static constexpr size_t row_texels = 1024; // as in the shader
+
+        // Uploads `count' texels as rows of `row_texels' into `texture',
+        // bound on `unit', growing it (never shrinking) as needed.
+        static void load(GLenum unit, GLuint texture, size_t& capacity,
+                         GLenum internal, GLenum format, GLenum type,
+                         void const* data, size_t count, size_t texel) noexcept
+        {
+            glActiveTexture(unit);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            auto rows = std::max<size_t>((count + row_texels - 1) / row_texels, 1);
+            if (rows * row_texels > capacity) {
+                glTexImage2D(GL_TEXTURE_2D, 0, internal, row_texels, rows, 0, format, type, nullptr);
+                capacity = rows * row_texels;
+            }
+            auto full = count / row_texels;
+            auto bytes = static_cast<char const*>(data);
+            if (full) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, row_texels, full, format, type, bytes);
+            }
+            if (auto rest = count % row_texels) {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, full, rest, 1, format, type,
+                                bytes + full * row_texels * texel);
+            }
+            glActiveTexture(GL_TEXTURE0);
+        }
+        void flush() noexcept {
+            if (!this->stale) {
+                return;
+            }
+            trace_scope scope("uniform upload");
+            glBindBuffer(GL_UNIFORM_BUFFER, this->ubo);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof (this->shadow), &this->shadow);
+            this->stale = false;
+        }
+
+        GLuint program = 0;
+        GLuint blit = 0;
+        GLuint current = 0;
+        GLuint vao = 0;
+        GLuint vbo = 0;
+        GLuint ubo = 0;
+        GLuint texture = 0;
+        int texture_size[2] = { };
+        GLuint points = 0;
+        size_t points_size = 0;
+        GLuint cells = 0;
+        size_t cells_size = 0;
+        std::vector<float> staging;
+        GLuint ink_texture = 0;
+        GLuint ink_fbo = 0;
+        int ink_size[2] = { };
+        GLuint scaled = 0;
+        GLuint scaled_fbo = 0;
+        int scaled_size[2] = { };
+        bool scaled_stale = true;
+        // std140 image of the `frame' block.
+        struct {
+            float resolution[2];
+            int32_t columns;
+            float scale;
+        } shadow = { { }, 0, 1 };
+        bool stale = false;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_RENDERER_HH_*/
@@ -0,0 +1,57 @@
+#ifndef INCLUDE_SAFE_HH_
+#define INCLUDE_SAFE_HH_
+
+#include <iostream>
+#include <source_location>
+#include <stdexcept>
+#include <memory>
+#include <utility>
+
+#include <unistd.h>
+
+namespace
+{
+    struct fatal_error : std::runtime_error {
+        fatal_error(char const* msg, std::source_location location)
+            : std::runtime_error(msg), location(location)
+            {
+            }
+        std::source_location location;
+    };
+    template <class Ch>
+    auto& operator<<(std::basic_ostream<Ch>& output, std::source_location const& loc) {
+        return output << loc.file_name() << ':'
+                      << loc.line() << ':'
+                      << loc.column() << ':'
+                      << loc.function_name() << ':';
+    }
+    template <class Ch>
+    auto& operator<<(std::basic_ostream<Ch>& output, fatal_error const& x) {
+        return output << x.location << x.what();
+    }
+
+    using location = std::source_location;
+    template <class T>
+    auto safe_ptr(T* ptr, auto del, location loc = location::current()) {
+        if (!ptr) {
+            throw fatal_error("bad pointer", loc);
+        }
+        return std::unique_ptr<T, decltype (del)>(ptr, del);
+    }
+
+    class safe_fd {
+    public:
+        explicit safe_fd(int fd, location loc = location::current()) : fd{fd} {
+            if (fd < 0) {
+                throw fatal_error("bad descriptor", loc);
+            }
+        }
+        safe_fd(safe_fd&& rhs) noexcept : fd{std::exchange(rhs.fd, -1)} { }
+        ~safe_fd() noexcept { if (this->fd >= 0) ::close(this->fd); }
+        int get() const noexcept { return this->fd; }
+    private:
+        int fd;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_SAFE_HH_*/
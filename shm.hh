@@ -0,0 +1,193 @@
+#ifndef INCLUDE_SHM_HH_
+#define INCLUDE_SHM_HH_
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <span>
+
+#include <sys/mman.h>
+
+#include <wayland-client.h>
+
+#include "safe.hh"
+#include "damage.hh"
+
+namespace
+{
+    // Software presentation through one memfd-backed wl_shm_pool carved into
+    // `count' ARGB8888 buffers.  A buffer is only handed out again after the
+    // compositor released it.  Resizing re-carves the same pool: it grows in
+    // place (ftruncate, wl_shm_pool.resize, mremap) when the new buffers do
+    // not fit, and otherwise keeps its high-water size, since a wl_shm_pool
+    // can never shrink.  Buffers of the old size that the compositor still
+    // holds are destroyed on release, and the slots they overlap stay out of
+    // use until then.
+    class shm_swapchain {
+    public:
+        static constexpr int count = 3;
+        struct buffer {
+            shm_swapchain* owner;
+            wl_buffer* handle;
+            size_t offset;
+            size_t size;
+            int width;
+            int height;
+            bool busy;
+            uint64_t serial; // damage_history serial of its contents, 0 if none
+            uint32_t* pixels() const noexcept {
+                return reinterpret_cast<uint32_t*>(static_cast<char*>(this->owner->base) +
+                                                   this->offset);
+            }
+            int stride() const noexcept { return this->width; }
+        };
+
+        shm_swapchain(wl_shm* shm, int width, int height)
+            : fd{memfd_create("wayland-sycl-client", MFD_CLOEXEC)}
+            {
+                auto size = buffer_size(width, height) * count;
+                this->reserve(size);
+                this->pool = safe_ptr(wl_shm_create_pool(shm, this->fd.get(), size),
+                                      wl_shm_pool_destroy);
+                this->resize(width, height);
+            }
+        ~shm_swapchain() noexcept {
+            for (auto& slot : this->slots) {
+                if (slot.handle) {
+                    wl_buffer_destroy(slot.handle);
+                }
+            }
+            for (auto& old : this->retired) {
+                if (old.handle) {
+                    wl_buffer_destroy(old.handle);
+                }
+            }
+            if (this->base) {
+                ::munmap(this->base, this->capacity);
+            }
+        }
+        shm_swapchain(shm_swapchain const&) = delete;
+        shm_swapchain& operator=(shm_swapchain const&) = delete;
+
+        void resize(int width, int height) {
+            if (width == this->width && height == this->height) {
+                return;
+            }
+            auto size = buffer_size(width, height);
+            if (size * count > this->capacity) {
+                this->reserve(size * count);
+                wl_shm_pool_resize(this->pool.get(), this->capacity);
+            }
+            for (int i = 0; i < count; ++i) {
+                auto& slot = this->slots[i];
+                if (slot.handle) {
+                    this->retire(slot);
+                }
+                slot = buffer {
+                    this, wl_shm_pool_create_buffer(this->pool.get(), i * size, width, height,
+                                                    width * 4, WL_SHM_FORMAT_ARGB8888),
+                    i * size, size, width, height, false, 0,
+                };
+                wl_buffer_add_listener(slot.handle, &buffer_listener, &slot);
+            }
+            this->width = width;
+            this->height = height;
+        }
+
+        // A buffer nobody else reads, or nullptr when all are still held by
+        // the compositor; its release then makes the next call succeed.
+        buffer* acquire() noexcept {
+            for (auto& slot : this->slots) {
+                if (!slot.busy && !this->overlaps_retired(slot)) {
+                    return &slot;
+                }
+            }
+            return nullptr;
+        }
+        // Attaches and commits `b' reporting only `damage' (bottom-left
+        // origin, as everywhere else) as changed; the buffer stays busy until
+        // wl_buffer.release.
+        void present(wl_surface* surface, buffer* b, std::span<rect const> damage) noexcept {
+            wl_surface_attach(surface, b->handle, 0, 0);
+            auto by_buffer = wl_surface_get_version(surface) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+            for (auto r : damage) {
+                (by_buffer ? wl_surface_damage_buffer : wl_surface_damage)(
+                    surface, r.x0, b->height - r.y1, r.width(), r.height());
+            }
+            wl_surface_commit(surface);
+            b->busy = true;
+        }
+
+    private:
+        static size_t buffer_size(int width, int height) noexcept {
+            // Page aligned, so every buffer starts on its own page.
+            auto size = static_cast<size_t>(width) * height * 4;
+            return (size + 4095) & ~size_t{4095};
+        }
+        void reserve(size_t size) {
+            if (::ftruncate(this->fd.get(), size) == -1) {
+                throw fatal_error("cannot size the shm pool", location::current());
+            }
+            auto base = this->base
+                ? ::mremap(this->base, this->capacity, size, MREMAP_MAYMOVE)
+                : ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd.get(), 0);
+            if (base == MAP_FAILED) {
+                throw fatal_error("cannot map the shm pool", location::current());
+            }
+            this->base = base;
+            this->capacity = size;
+        }
+        // A buffer the compositor still holds is kept until its release,
+        // however many resizes are in flight.
+        void retire(buffer& slot) {
+            if (!slot.busy) {
+                wl_buffer_destroy(slot.handle);
+                return;
+            }
+            for (auto& old : this->retired) {
+                if (!old.handle) {
+                    old = slot;
+                    wl_buffer_set_user_data(old.handle, &old);
+                    return;
+                }
+            }
+            auto& old = this->retired.emplace_back(slot);
+            wl_buffer_set_user_data(old.handle, &old);
+        }
+        bool overlaps_retired(buffer const& slot) const noexcept {
+            for (auto const& old : this->retired) {
+                if (old.handle &&
+                    old.offset < slot.offset + slot.size &&
+                    slot.offset < old.offset + old.size)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+        static void release(void* data, wl_buffer*) noexcept {
+            auto b = static_cast<buffer*>(data);
+            auto self = b->owner;
+            if (self->slots.data() <= b && b < self->slots.data() + count) {
+                b->busy = false;
+            }
+            else {
+                wl_buffer_destroy(b->handle);
+                b->handle = nullptr;
+            }
+        }
+        static constexpr wl_buffer_listener buffer_listener = { release };
+
+        safe_fd fd;
+        void* base = nullptr;
+        size_t capacity = 0;
+        std::unique_ptr<wl_shm_pool, void (*)(wl_shm_pool*)> pool{nullptr, wl_shm_pool_destroy};
+        std::array<buffer, count> slots = { };
+        // Grows at the back only, so release() can point into it.
+        std::deque<buffer> retired;
+        int width = 0;
+        int height = 0;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_SHM_HH_*/
@@ -0,0 +1,72 @@
+#ifndef INCLUDE_SLAB_HH_
+#define INCLUDE_SLAB_HH_
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace
+{
+    // Object pool for one type.  Storage is taken from the heap in chunks of
+    // `chunk' slots and never given back, so objects that come and go (one
+    // per hot-plugged tool, say) keep reusing the same memory.  make() and
+    // destroy() may be called from any thread.
+    template <class T, size_t chunk = 64>
+    class slab {
+    public:
+        slab() = default;
+        slab(slab const&) = delete;
+        slab& operator=(slab const&) = delete;
+
+        template <class... Args>
+        T* make(Args&&... args) {
+            slot* s;
+            {
+                std::lock_guard lock(this->mutex);
+                if (!this->free) {
+                    this->grow();
+                }
+                s = this->free;
+                this->free = s->next;
+            }
+            try {
+                return ::new (s->storage) T(std::forward<Args>(args)...);
+            }
+            catch (...) {
+                this->recycle(s);
+                throw;
+            }
+        }
+        void destroy(T* object) noexcept {
+            object->~T();
+            this->recycle(reinterpret_cast<slot*>(object));
+        }
+
+    private:
+        union slot {
+            slot* next;
+            alignas(T) unsigned char storage[sizeof (T)];
+        };
+        void grow() {
+            auto& block = this->chunks.emplace_back(std::make_unique<slot[]>(chunk));
+            for (size_t i = 0; i < chunk; ++i) {
+                block[i].next = this->free;
+                this->free = &block[i];
+            }
+        }
+        void recycle(slot* s) noexcept {
+            std::lock_guard lock(this->mutex);
+            s->next = this->free;
+            this->free = s;
+        }
+
+        std::mutex mutex;
+        slot* free = nullptr;
+        std::vector<std::unique_ptr<slot[]>> chunks;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_SLAB_HH_*/
@@ -0,0 +1,113 @@
+#ifndef INCLUDE_STARTUP_HH_
+#define INCLUDE_STARTUP_HH_
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/eventfd.h>
+
+#include "safe.hh"
+#include "input.hh"
+
+namespace
+{
+    // When each startup phase ran and on which thread, for the report printed
+    // once the first frame is out.  Phases may be recorded from any thread.
+    class startup_timeline {
+    public:
+        startup_timeline() noexcept
+            : origin{monotonic_ns()}, main{std::this_thread::get_id()}
+            {
+            }
+
+        void mark(char const* name, uint64_t begin, uint64_t end) {
+            std::lock_guard lock(this->mutex);
+            this->phases.push_back({ name, begin, end, std::this_thread::get_id() != this->main });
+        }
+        // Runs `f' as the phase `name'.
+        template <class F>
+        decltype(auto) phase(char const* name, F&& f) {
+            struct guard {
+                startup_timeline* timeline;
+                char const* name;
+                uint64_t begin;
+                ~guard() { this->timeline->mark(this->name, this->begin, monotonic_ns()); }
+            } g{this, name, monotonic_ns()};
+            return std::forward<F>(f)();
+        }
+
+        template <class Ch>
+        friend auto& operator<<(std::basic_ostream<Ch>& output, startup_timeline& t) {
+            std::lock_guard lock(t.mutex);
+            std::sort(t.phases.begin(), t.phases.end(),
+                      [](auto const& a, auto const& b) noexcept { return a.begin < b.begin; });
+            auto ms = [](uint64_t ns) { return ns * 1e-6; };
+            output << "startup:";
+            for (auto const& p : t.phases) {
+                output << "\n  " << (p.worker ? "[worker] " : "[main]   ") << p.name
+                       << ": +" << ms(p.begin - t.origin) << " ms, " << ms(p.end - p.begin) << " ms";
+            }
+            return output;
+        }
+
+    private:
+        struct phase_record {
+            char const* name;
+            uint64_t begin;
+            uint64_t end;
+            bool worker;
+        };
+        uint64_t origin;
+        std::thread::id main;
+        std::mutex mutex;
+        std::vector<phase_record> phases;
+    };
+
+    // Runs `f' on a thread of its own right away.  fd() becomes readable when
+    // the result is in, so a coroutine can await it with
+    // executor::signalled(); get() hands it over, or rethrows what `f'
+    // threw.
+    template <class T>
+    class background {
+    public:
+        template <class F>
+        explicit background(F&& f)
+            : ready{eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)},
+              thread{[this, f = std::forward<F>(f)]() mutable noexcept {
+                  try {
+                      this->result.emplace(f());
+                  }
+                  catch (...) {
+                      this->error = std::current_exception();
+                  }
+                  eventfd_write(this->ready.get(), 1);
+              }}
+            {
+            }
+        background(background const&) = delete;
+        background& operator=(background const&) = delete;
+
+        int fd() const noexcept { return this->ready.get(); }
+        T get() {
+            this->thread.join();
+            if (this->error) {
+                std::rethrow_exception(this->error);
+            }
+            return std::move(*this->result);
+        }
+
+    private:
+        safe_fd ready;
+        std::optional<T> result;
+        std::exception_ptr error;
+        std::jthread thread;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_STARTUP_HH_*/
@@ -0,0 +1,251 @@
+#ifndef INCLUDE_STROKE_HH_
+#define INCLUDE_STROKE_HH_
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <linux/input-event-codes.h>
+#include <wayland-client.h>
+
+#include "input.hh"
+#include "field.hh"
+
+namespace
+{
+    // One stamp of the brush, in surface-local pixels with a top-left origin
+    // so strokes stay put when the window is resized.
+    struct dab {
+        float x;
+        float y;
+        float radius;
+        float alpha;
+    };
+
+    // Coverage of `d' at distance `r' from its centre: solid inside, with a
+    // one pixel soft edge.
+    inline float dab_coverage(dab const& d, float r) noexcept {
+        return d.alpha * (1 - smoothstep(d.radius - 1, d.radius, r));
+    }
+
+    // Turns tablet tool, touch and pointer records into dabs.  All state a
+    // tool reports within one zwp_tablet_tool_v2 frame becomes a single
+    // sample, as does a finger's within a wl_touch frame and the pointer's,
+    // with the left button held, within a wl_pointer frame.  While a tool
+    // touches the surface the samples are joined by a Catmull-Rom spline,
+    // which is walked at a spacing of a quarter of the brush radius, so
+    // every sample shapes the stroke however fast the pen moves.  A segment
+    // is drawn once the sample after it arrives, one report late, and the
+    // last one when the pen lifts.  Only the dabs made since settle() are
+    // kept; the stroke history lives wherever they were drawn.
+    class stroke_engine {
+    public:
+        static constexpr float brush_radius = 6;
+
+        void apply(input_event const& ev) {
+            auto move = [&](contact c) {
+                auto& s = this->find(contact_key(c, ev.id)).pending;
+                s.x = ev.x;
+                s.y = ev.y;
+            };
+            auto tool = [&]() -> auto& { return this->find(contact_key(contact::tool, ev.id)); };
+            auto finger = [&]() -> auto& { return this->find(contact_key(contact::touch, ev.id)); };
+            switch (ev.kind) {
+            case input_kind::tool_proximity_in:
+                tool().gone = false;
+                break;
+            case input_kind::tool_down:
+                tool().pending.down = true;
+                break;
+            case input_kind::tool_up:
+                tool().pending.down = false;
+                break;
+            case input_kind::tool_proximity_out: {
+                auto& t = tool();
+                t.pending.down = false;
+                t.gone = true;
+                break;
+            }
+            case input_kind::tool_motion:
+                move(contact::tool);
+                break;
+            case input_kind::tool_pressure:
+                tool().pending.pressure = ev.value / 65535.0f;
+                break;
+            case input_kind::tool_tilt:
+                tool().pending.tilt = std::hypot(ev.x, ev.y);
+                break;
+            case input_kind::tool_frame:
+                this->commit(tool());
+                this->forget();
+                break;
+            case input_kind::touch_down: {
+                move(contact::touch);
+                auto& t = finger();
+                t.pending.down = true;
+                t.gone = false;
+                break;
+            }
+            case input_kind::touch_motion:
+                move(contact::touch);
+                break;
+            case input_kind::touch_up: {
+                auto& t = finger();
+                t.pending.down = false;
+                t.gone = true;
+                break;
+            }
+            case input_kind::touch_cancel:
+                for (auto& t : this->tools) {
+                    if (t.key >> 32 == static_cast<uint32_t>(contact::touch)) {
+                        t.pending.down = false;
+                        t.gone = true;
+                    }
+                }
+                [[fallthrough]];
+            case input_kind::touch_frame:
+                for (auto& t : this->tools) {
+                    if (t.key >> 32 == static_cast<uint32_t>(contact::touch)) {
+                        this->commit(t);
+                    }
+                }
+                this->forget();
+                break;
+            case input_kind::pointer_motion:
+                move(contact::pointer);
+                break;
+            case input_kind::pointer_button:
+                if (static_cast<uint32_t>(ev.id) == BTN_LEFT) {
+                    this->find(contact_key(contact::pointer, 0)).pending.down =
+                        ev.value == WL_POINTER_BUTTON_STATE_PRESSED;
+                }
+                break;
+            case input_kind::pointer_frame:
+                this->commit(this->find(contact_key(contact::pointer, 0)));
+                break;
+            default:
+                break;
+            }
+        }
+
+        // The dabs made since the last settle(), oldest first.
+        std::span<dab const> fresh() const noexcept { return this->dabs; }
+        // Whether a stroke began since the last settle().
+        bool started() const noexcept { return this->began; }
+        void settle() noexcept {
+            this->dabs.clear();
+            this->began = false;
+        }
+
+    private:
+        struct sample {
+            float x = 0;
+            float y = 0;
+            float pressure = 1; // until the tool reports one
+            float tilt = 0;     // degrees from the surface normal
+            bool down = false;
+        };
+        struct tool {
+            uint64_t key; // contact_key()
+            sample pending;
+            // The newest three samples of the stroke, oldest first.
+            std::array<sample, 3> window;
+            int count = 0; // samples in the stroke, 0 while lifted
+            float travelled = 0; // since the last dab
+            bool gone = false; // finger lifted or tool out of proximity
+        };
+
+        tool& find(uint64_t key) {
+            auto it = std::find_if(this->tools.begin(), this->tools.end(),
+                                   [key](auto const& t) noexcept { return t.key == key; });
+            if (it != this->tools.end()) {
+                return *it;
+            }
+            return this->tools.emplace_back(tool{key, { }, { }});
+        }
+        // Drops the contacts that went away, once their frame committed the
+        // end of their stroke, so only live ones are ever searched.
+        void forget() noexcept {
+            std::erase_if(this->tools, [](tool const& t) noexcept { return t.gone; });
+        }
+        void commit(tool& t) {
+            auto& s = t.pending;
+            auto& w = t.window;
+            if (!s.down) {
+                if (t.count > 1) {
+                    this->segment(t, w[0], w[1], w[2], w[2]);
+                }
+                t.count = 0;
+                return;
+            }
+            if (t.count == 0) {
+                w = { s, s, s };
+                t.count = 1;
+                t.travelled = 0;
+                this->began = true;
+                this->stamp(s.x, s.y, s.pressure, s.tilt);
+                return;
+            }
+            if (s.x == w[2].x && s.y == w[2].y) {
+                w[2].pressure = s.pressure;
+                w[2].tilt = s.tilt;
+                return;
+            }
+            if (t.count > 1) {
+                this->segment(t, w[0], w[1], w[2], s);
+            }
+            w = { w[1], w[2], s };
+            ++t.count;
+        }
+        // Walks the spline from p1 to p2, steering by p0 and p3.
+        void segment(tool& t, sample const& p0, sample const& p1, sample const& p2,
+                     sample const& p3)
+        {
+            auto at = [&](float u, auto member) noexcept {
+                auto a = p0.*member, b = p1.*member, c = p2.*member, d = p3.*member;
+                return 0.5f * (2 * b + (c - a) * u + (2 * a - 5 * b + 4 * c - d) * u * u +
+                               (3 * b - a - 3 * c + d) * u * u * u);
+            };
+            auto chord = std::hypot(p2.x - p1.x, p2.y - p1.y);
+            auto steps = std::clamp(static_cast<int>(std::ceil(chord)), 1, 256);
+            auto qx = p1.x;
+            auto qy = p1.y;
+            for (int k = 1; k <= steps; ++k) {
+                auto u = static_cast<float>(k) / steps;
+                auto x = at(u, &sample::x);
+                auto y = at(u, &sample::y);
+                auto pressure = std::clamp(at(u, &sample::pressure), 0.0f, 1.0f);
+                auto tilt = std::max(at(u, &sample::tilt), 0.0f);
+                auto spacing = std::max(0.5f, 0.25f * radius(pressure, tilt));
+                auto d = std::hypot(x - qx, y - qy);
+                while (t.travelled + d >= spacing) {
+                    auto f = (spacing - t.travelled) / d;
+                    qx += (x - qx) * f;
+                    qy += (y - qy) * f;
+                    d -= spacing - t.travelled;
+                    t.travelled = 0;
+                    this->stamp(qx, qy, pressure, tilt);
+                }
+                t.travelled += d;
+                qx = x;
+                qy = y;
+            }
+        }
+        // Light pressure thins the line; tilting the pen broadens it.
+        static float radius(float pressure, float tilt) noexcept {
+            return brush_radius * (0.15f + 0.85f * pressure) * (1 + std::min(tilt, 60.0f) / 120);
+        }
+        void stamp(float x, float y, float pressure, float tilt) {
+            this->dabs.push_back({ x, y, radius(pressure, tilt), 1 });
+        }
+
+        std::vector<tool> tools;
+        std::vector<dab> dabs;
+        bool began = false;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_STROKE_HH_*/
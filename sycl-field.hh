@@ -0,0 +1,115 @@
+#ifndef INCLUDE_SYCL_FIELD_HH_
+#define INCLUDE_SYCL_FIELD_HH_
+
+#include <algorithm>
+#include <string_view>
+
+#include <CL/sycl.hpp>
+
+#include "safe.hh"
+#include "field.hh"
+#include "trace.hh"
+
+namespace
+{
+    inline auto select_device(std::string_view kind, location loc = location::current()) {
+        try {
+            if (kind == "cpu") {
+                return sycl::device(sycl::cpu_selector{});
+            }
+            if (kind == "gpu") {
+                return sycl::device(sycl::gpu_selector{});
+            }
+            return sycl::device(sycl::default_selector{});
+        }
+        catch (sycl::exception const&) {
+            throw fatal_error("no SYCL device", loc);
+        }
+    }
+
+    // Evaluates the brightness field on a SYCL device into a USM image.  The
+    // queue, the image and the shared copies of the points and their tile
+    // lists live as long as the object and only ever grow, so resizing the
+    // window back and forth or touching with more fingers does not keep
+    // reallocating.
+    class sycl_field {
+    public:
+        explicit sycl_field(sycl::device const& device)
+            : queue{device, sycl::property_list{sycl::property::queue::in_order{},
+                                                sycl::property::queue::enable_profiling{}}}
+            {
+            }
+        ~sycl_field() noexcept {
+            for (void* p : { static_cast<void*>(this->pixels), static_cast<void*>(this->points),
+                             static_cast<void*>(this->cells) }) {
+                if (p) sycl::free(p, this->queue);
+            }
+        }
+        sycl_field(sycl_field const&) = delete;
+        sycl_field& operator=(sycl_field const&) = delete;
+
+        // Runs the kernel and returns the host-visible RGBA8 image, bottom row
+        // first, ready for glTexSubImage2D.  The image covers the window at
+        // `scale' times its resolution.
+        uint32_t const* compute(field_params const& host, int width, int height, float scale = 1) {
+            trace_scope scope("sycl compute");
+            this->reserve(this->pixels, this->capacity, static_cast<size_t>(width) * height);
+            this->reserve(this->points, this->point_capacity, 2 * host.point_count);
+            this->reserve(this->cells, this->cell_capacity, host.cell_count);
+            std::copy_n(host.x, host.point_count, this->points);
+            std::copy_n(host.y, host.point_count, this->points + host.point_count);
+            std::copy_n(host.cells, host.cell_count, this->cells);
+            auto params = host;
+            params.x = this->points;
+            params.y = this->points + host.point_count;
+            params.cells = this->cells;
+            auto event = this->queue.parallel_for(
+                sycl::range<2>(height, width),
+                [=, pixels = this->pixels](sycl::id<2> idx) {
+                    auto y = idx[0];
+                    auto x = idx[1];
+                    pixels[y * width + x] = shade((x + 0.5f) / scale, (y + 0.5f) / scale, params);
+                });
+            event.wait();
+            this->elapsed =
+                event.get_profiling_info<sycl::info::event_profiling::command_end>() -
+                event.get_profiling_info<sycl::info::event_profiling::command_start>();
+            return this->pixels;
+        }
+        // Device time of the last kernel, in nanoseconds.
+        uint64_t kernel_ns() const noexcept { return this->elapsed; }
+        auto device_name() const {
+            return this->queue.get_device().get_info<sycl::info::device::name>();
+        }
+
+    private:
+        template <class T>
+        void reserve(T*& data, size_t& capacity, size_t size,
+                     location loc = location::current())
+        {
+            if (size <= capacity) {
+                return;
+            }
+            if (data) {
+                sycl::free(data, this->queue);
+            }
+            capacity = 0;
+            data = sycl::malloc_shared<T>(size, this->queue);
+            if (!data) {
+                throw fatal_error("cannot allocate the field", loc);
+            }
+            capacity = size;
+        }
+
+        sycl::queue queue;
+        uint32_t* pixels = nullptr;
+        size_t capacity = 0;
+        float* points = nullptr; // all x, then all y
+        size_t point_capacity = 0;
+        uint32_t* cells = nullptr;
+        size_t cell_capacity = 0;
+        uint64_t elapsed = 0;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_SYCL_FIELD_HH_*/
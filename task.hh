@@ -0,0 +1,82 @@
+#ifndef INCLUDE_TASK_HH_
+#define INCLUDE_TASK_HH_
+
+#include <coroutine>
+#include <utility>
+
+template <class T>
+struct task_result {
+    T result;
+    void return_value(T value) noexcept { this->result = std::move(value); }
+    T take() noexcept { return std::move(this->result); }
+};
+template <>
+struct task_result<void> {
+    void return_void() noexcept { }
+    void take() noexcept { }
+};
+
+// Lazily started coroutine: it runs when it is awaited, called, or handed to
+// an executor, and resumes whoever awaited it when it finishes.
+template <class T>
+class task {
+public:
+    struct promise_type : task_result<T> {
+        std::coroutine_handle<> continuation;
+        void unhandled_exception() { throw; }
+        auto get_return_object() noexcept { return task{*this}; }
+        auto initial_suspend() noexcept { return std::suspend_always{}; }
+        auto final_suspend() noexcept {
+            struct awaiter {
+                bool await_ready() noexcept { return false; }
+                void await_resume() noexcept { }
+                auto await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    std::coroutine_handle<> continuation = handle.promise().continuation;
+                    if (!continuation) {
+                        continuation = std::noop_coroutine();
+                    }
+                    return continuation;
+                }
+            };
+            return awaiter{};
+        }
+    };
+    ~task() noexcept { if (this->handle) this->handle.destroy(); }
+    task() : handle{nullptr} { }
+    task(task&& rhs) noexcept : handle{std::exchange(rhs.handle, nullptr)} { }
+    task& operator=(task&& rhs) noexcept {
+        if (this != &rhs) {
+            if (this->handle) this->handle.destroy();
+            this->handle = std::exchange(rhs.handle, nullptr);
+        }
+        return *this;
+    }
+    auto operator co_await() noexcept {
+        struct awaiter {
+            std::coroutine_handle<promise_type> handle;
+            bool await_ready() noexcept { return false; }
+            T await_resume() noexcept { return this->handle.promise().take(); }
+            auto await_suspend(std::coroutine_handle<> handle) noexcept {
+                this->handle.promise().continuation = handle;
+                return this->handle;
+            }
+        };
+        return awaiter{this->handle};
+    }
+    T operator()() {
+        this->handle.resume();
+        return this->handle.promise().take();
+    }
+    // For executors, which resume the coroutine themselves and reap it once
+    // it is done.
+    std::coroutine_handle<> coroutine() const noexcept { return this->handle; }
+    bool done() const noexcept { return !this->handle || this->handle.done(); }
+private:
+    explicit task(promise_type& p)
+        : handle{std::coroutine_handle<promise_type>::from_promise(p)}
+        {
+        }
+    std::coroutine_handle<promise_type> handle;
+};
+
+#endif/*INCLUDE_TASK_HH_*/
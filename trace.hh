@@ -0,0 +1,182 @@
+#ifndef INCLUDE_TRACE_HH_
+#define INCLUDE_TRACE_HH_
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+
+#include "safe.hh"
+#include "input.hh"
+
+namespace
+{
+    // Scoped trace points around the phases of a frame, captured between
+    // start() and stop() and written as Chrome trace-event JSON for
+    // chrome://tracing or ui.perfetto.dev.  Each thread records into a
+    // buffer of its own, made the first time it records: a slot store and a
+    // release of the count, no lock, allocation or system call.  Events that
+    // no longer fit are counted and dropped rather than overwriting the ones
+    // write() may be reading.  While no capture runs, a trace point costs a
+    // relaxed load and a branch, so they stay compiled in.
+    class tracer {
+    public:
+        static constexpr uint32_t capacity = 1 << 16; // events per thread and capture
+
+        static tracer& instance() {
+            static tracer t;
+            return t;
+        }
+
+        bool enabled() const noexcept { return this->on.load(std::memory_order_relaxed); }
+        // A new capture; whatever the previous one held is dropped as each
+        // thread records its first event.
+        void start() noexcept {
+            this->generation.fetch_add(1, std::memory_order_release);
+            this->on.store(true, std::memory_order_relaxed);
+        }
+        void stop() noexcept { this->on.store(false, std::memory_order_relaxed); }
+
+        // Names the calling thread in the trace; `name' must outlive it.
+        void name_thread(char const* name) {
+            thread_name() = name;
+            if (auto b = local_buffer()) {
+                b->name.store(name, std::memory_order_relaxed);
+            }
+        }
+
+        void record(char const* name, uint64_t begin, uint64_t end) noexcept {
+            auto b = local_buffer();
+            if (!b) {
+                try {
+                    b = this->add_buffer();
+                }
+                catch (...) {
+                    return;
+                }
+            }
+            auto g = this->generation.load(std::memory_order_acquire);
+            if (b->generation.load(std::memory_order_relaxed) != g) {
+                b->size.store(0, std::memory_order_relaxed);
+                b->dropped.store(0, std::memory_order_relaxed);
+                b->generation.store(g, std::memory_order_release);
+            }
+            auto n = b->size.load(std::memory_order_relaxed);
+            if (n == capacity) {
+                b->dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            b->events[n] = { name, begin, end };
+            b->size.store(n + 1, std::memory_order_release);
+        }
+
+        // Writes every event of the current capture to `path'.  Event names
+        // are literals and protocol interface names, which need no escaping.
+        // Returns the number of events dropped.
+        uint64_t write(char const* path, location loc = location::current()) {
+            std::ofstream output(path);
+            if (!output) {
+                throw fatal_error("cannot open the trace file", loc);
+            }
+            auto pid = ::getpid();
+            auto g = this->generation.load(std::memory_order_acquire);
+            uint64_t dropped = 0;
+            char const* separator = "\n";
+            output << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            output.setf(std::ios::fixed);
+            output.precision(3);
+            std::lock_guard lock(this->mutex);
+            for (auto const& b : this->buffers) {
+                if (auto name = b->name.load(std::memory_order_relaxed)) {
+                    output << separator << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << pid
+                           << ",\"tid\":" << b->tid << ",\"args\":{\"name\":\"" << name << "\"}}";
+                    separator = ",\n";
+                }
+                if (b->generation.load(std::memory_order_acquire) != g) {
+                    continue;
+                }
+                auto n = b->size.load(std::memory_order_acquire);
+                for (uint32_t i = 0; i < n; ++i) {
+                    auto const& e = b->events[i];
+                    output << separator << "{\"ph\":\"X\",\"name\":\"" << e.name << "\",\"pid\":" << pid
+                           << ",\"tid\":" << b->tid << ",\"ts\":" << e.begin * 1e-3
+                           << ",\"dur\":" << (e.end - e.begin) * 1e-3 << '}';
+                    separator = ",\n";
+                }
+                dropped += b->dropped.load(std::memory_order_relaxed);
+            }
+            output << "\n]}\n";
+            if (!output) {
+                throw fatal_error("cannot write the trace file", loc);
+            }
+            return dropped;
+        }
+
+    private:
+        struct event {
+            char const* name;
+            uint64_t begin;
+            uint64_t end;
+        };
+        struct buffer {
+            pid_t tid = ::gettid();
+            std::atomic<char const*> name = nullptr;
+            std::atomic<uint64_t> generation = 0;
+            std::atomic<uint32_t> size = 0;
+            std::atomic<uint32_t> dropped = 0;
+            std::unique_ptr<event[]> events = std::make_unique<event[]>(capacity);
+        };
+
+        tracer() = default;
+
+        static char const*& thread_name() noexcept {
+            thread_local char const* name = nullptr;
+            return name;
+        }
+        static buffer*& local_buffer() noexcept {
+            thread_local buffer* b = nullptr;
+            return b;
+        }
+        // Buffers stay with the tracer after their thread ends, so write()
+        // never races a thread going away.
+        buffer* add_buffer() {
+            auto b = std::make_unique<buffer>();
+            b->name.store(thread_name(), std::memory_order_relaxed);
+            std::lock_guard lock(this->mutex);
+            return local_buffer() = this->buffers.emplace_back(std::move(b)).get();
+        }
+
+        std::atomic<bool> on = false;
+        std::atomic<uint64_t> generation = 0;
+        std::mutex mutex;
+        std::vector<std::unique_ptr<buffer>> buffers;
+    };
+
+    // Records the time from construction to destruction as the event `name',
+    // which must be a literal or otherwise outlive the capture.
+    class trace_scope {
+    public:
+        explicit trace_scope(char const* name) noexcept
+            : name{name},
+              begin{tracer::instance().enabled() ? monotonic_ns() : 0}
+            {
+            }
+        ~trace_scope() noexcept {
+            if (this->begin) {
+                tracer::instance().record(this->name, this->begin, monotonic_ns());
+            }
+        }
+        trace_scope(trace_scope const&) = delete;
+        trace_scope& operator=(trace_scope const&) = delete;
+
+    private:
+        char const* name;
+        uint64_t begin;
+    };
+} // ::(anonymous)
+
+#endif/*INCLUDE_TRACE_HH_*/